@@ -0,0 +1,37 @@
+#include "adversarial_utils.h"
+
+namespace hps
+{
+namespace ntg
+{
+
+detail::PosWeightKeys::PosWeightKeys()
+{
+  unsigned long long x = Seed;
+  for (int posIdx = 0; posIdx < Board::Positions; ++posIdx)
+  {
+    keys[posIdx][Board::Empty] = 0ULL;
+    for (int w = 1; w < Weights; ++w)
+    {
+      keys[posIdx][w] = SplitMix64(&x);
+    }
+  }
+}
+
+const detail::PosWeightKeys detail::s_posWeightKeys;
+
+unsigned long long PosWeightKeysChecksum()
+{
+  unsigned long long checksum = 0ULL;
+  for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+  {
+    for (Weight w = 0; w < detail::PosWeightKeys::Weights; ++w)
+    {
+      checksum = ((checksum << 7) | (checksum >> 57)) ^ HashPosWeight(pos, w);
+    }
+  }
+  return checksum;
+}
+
+}
+}
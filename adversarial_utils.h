@@ -1,6 +1,11 @@
 #ifndef _NO_TIPPING_GAME_ADVERSARIAL_UTILS_H_
 #define _NO_TIPPING_GAME_ADVERSARIAL_UTILS_H_
+#include "ntg.h"
 #include "combination.h"
+#include "win_state_table.h"
+#include "thread.h"
+#include <atomic>
+#include <omp.h>
 
 #if NDEBUG
 #define HPS_NTG_ASSERT_BOARD_HASH_NO_DUPS(states)
@@ -14,6 +19,17 @@
       }
 #endif
 
+// Hint that memory will be read soon.
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define HPS_NTG_PREFETCH(addr)                                                 \
+  _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define HPS_NTG_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HPS_NTG_PREFETCH(addr)
+#endif
+
 namespace hps
 {
 namespace ntg
@@ -327,57 +343,84 @@ inline int DoubleWeightStatesNoConflictNoRemove(const Board& conflictBoard,
 
 namespace detail
 {
-inline void HashPosWeight(const int p, const int w, unsigned int* h)
+/// <summary> Random 64-bit keys for every (position, weight) pair. </summary>
+/// <remarks>
+///   <para> Keys are drawn from a fixed-seed SplitMix64 sequence so that they
+///     are identical across runs and builds. The key of an empty position is
+///     zero so that a whole board may be folded without testing for weights.
+///   </para>
+/// </remarks>
+struct PosWeightKeys
 {
-  assert(Board::Empty != w);
+  enum { Weights = Player::NumWeights + 1, };
+  enum { Seed = 0x4e544721, };
 
-  // Encode position.
-  {
-    const unsigned int highorder = *h & 0xf8000000;
-    *h = *h << 5;
-    *h = *h ^ (highorder >> 27);
-    *h = *h ^ p;
-  }
-  // Encode weight.
-  {
-    const unsigned int highorder = *h & 0xf8000000;
-    *h = *h << 5;
-    *h = *h ^ (highorder >> 27);
-    *h = *h ^ w;
-  }
+  PosWeightKeys();
+
+  unsigned long long keys[Board::Positions][Weights];
+};
+extern const PosWeightKeys s_posWeightKeys;
+
+/// <summary> Next value from a SplitMix64 sequence. </summary>
+inline unsigned long long SplitMix64(unsigned long long* x)
+{
+  assert(x);
+  unsigned long long z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
 }
 }
 
-inline unsigned int HashBoardCRC(const Board& board)
+/// <summary> Key for a single weight at a board position. </summary>
+inline unsigned long long HashPosWeight(const int p, const Weight w)
+{
+  assert(p >= -Board::Size);
+  assert(p <= Board::Size);
+  assert(w >= 0);
+  assert(w < detail::PosWeightKeys::Weights);
+  return detail::s_posWeightKeys.keys[p + Board::Size][w];
+}
+
+/// <summary> Fold every (position, weight) key into one value. </summary>
+/// <remarks>
+///   <para> Files that store board keys record it so that files written with
+///     a different key scheme are rejected.
+///   </para>
+/// </remarks>
+unsigned long long PosWeightKeysChecksum();
+
+/// <summary> Hash a board as the XOR of its (position, weight) keys. </summary>
+/// <remarks>
+///   <para> The key of any sub-board is the XOR of the keys of its weights.
+///     This allows the key of a subset of weights to be updated in O(1) as
+///     members enter and leave the subset.
+///   </para>
+/// </remarks>
+inline unsigned long long HashBoard(const Board& board)
 {
-  // reissb -- 20111009 -- Taken from
-  //   http://www.cs.hmc.edu/~geoff/classes/hmc.cs070.200101/
-  //     homework10/hashfuncs.html
-  unsigned int h = 0;
-  int p = -Board::Size;
-  for (Board::const_iterator w = board.begin(); w != board.end(); ++w, ++p)
+  const unsigned long long* posKeys = detail::s_posWeightKeys.keys[0];
+  unsigned long long h = 0ULL;
+  for (Board::const_iterator w = board.begin();
+       w != board.end();
+       ++w, posKeys += detail::PosWeightKeys::Weights)
   {
-    if (Board::Empty != *w)
-    {
-      detail::HashPosWeight(p, *w, &h);
-    }
+    assert(*w < detail::PosWeightKeys::Weights);
+    h ^= posKeys[*w];
   }
   return h;
 }
 
-inline unsigned int HashPosWeightPairsCRC(const int count,
-                                          const std::pair<int, int>* posWeightPairs)
+inline unsigned long long HashPosWeightPairs(const int count,
+                                             const std::pair<int, int>* posWeightPairs)
 {
-  // reissb -- 20111009 -- Taken from
-  //   http://www.cs.hmc.edu/~geoff/classes/hmc.cs070.200101/
-  //     homework10/hashfuncs.html
-  unsigned int h = 0;
+  unsigned long long h = 0ULL;
   const std::pair<int, int>* posWeightPairsEnd = posWeightPairs + count;
   for (const std::pair<int, int>* posWeightPair = posWeightPairs;
        posWeightPair != posWeightPairsEnd;
        ++posWeightPair)
   {
-    detail::HashPosWeight(posWeightPair->first, posWeightPair->second, &h);
+    h ^= HashPosWeight(posWeightPair->first, posWeightPair->second);
   }
   return h;
 }
@@ -385,8 +428,8 @@ inline unsigned int HashPosWeightPairsCRC(const int count,
 /// <summary> A key for a board state. </summary>
 struct BoardHashKey
 {
-  explicit BoardHashKey(const unsigned int key_) : key(key_) {}
-  BoardHashKey(const Board& board) : key(HashBoardCRC(board)) {}
+  explicit BoardHashKey(const unsigned long long key_) : key(key_) {}
+  BoardHashKey(const Board& board) : key(HashBoard(board)) {}
   inline bool operator<(const BoardHashKey& rhs) const
   {
     return key < rhs.key;
@@ -399,294 +442,1908 @@ struct BoardHashKey
   {
     return !(*this == rhs);
   }
-  unsigned int key;
+  unsigned long long key;
 };
+typedef char BoardHashKeySizeCheck[(sizeof(BoardHashKey) ==
+                                    sizeof(unsigned long long)) ? 1 : -1];
 
-struct BoardEvaluationReachableWinStates
+/// <summary> A board packed as one 4-bit weight per position. </summary>
+struct PackedBoard
 {
-  typedef std::vector<BoardHashKey> BoardHashList;
-  struct NumWeightsWinStates
+  enum { BitsPerPosition = 4, };
+  enum { PositionsPerWord = 64 / BitsPerPosition, };
+  enum { Words = (Board::Positions + PositionsPerWord - 1) / PositionsPerWord, };
+  enum { PositionMask = (1 << BitsPerPosition) - 1, };
+
+  PackedBoard()
   {
-    int numWeights;
-    BoardHashList states;
-  };
-  typedef std::vector<NumWeightsWinStates> WinStateList;
+    memset(words, 0, sizeof(words));
+  }
+  explicit PackedBoard(const Board& board)
+  {
+    memset(words, 0, sizeof(words));
+    int pos = -Board::Size;
+    for (Board::const_iterator w = board.begin(); w != board.end(); ++w, ++pos)
+    {
+      if (Board::Empty != *w)
+      {
+        Set(pos, *w);
+      }
+    }
+  }
 
-  /// <summary> Adapt boards to keys. </summary>
-  struct BoardHashStorageAdapter
+  inline void Set(const int pos, const Weight w)
   {
-    inline BoardHashKey operator()(const Board& board) const
+    assert((w >= 0) && (w <= PositionMask));
+    const int idx = pos + Board::Size;
+    const int shift = (idx % PositionsPerWord) * BitsPerPosition;
+    unsigned long long& word = words[idx / PositionsPerWord];
+    word = (word & ~(static_cast<unsigned long long>(PositionMask) << shift)) |
+           (static_cast<unsigned long long>(w) << shift);
+  }
+  inline Weight Get(const int pos) const
+  {
+    const int idx = pos + Board::Size;
+    const int shift = (idx % PositionsPerWord) * BitsPerPosition;
+    return static_cast<Weight>((words[idx / PositionsPerWord] >> shift) &
+                               PositionMask);
+  }
+
+  unsigned long long words[Words];
+};
+typedef char PackedBoardWeightCheck[
+  ((static_cast<int>(Player::NumWeights) <=
+    static_cast<int>(PackedBoard::PositionMask)) &&
+   (static_cast<int>(Board::BoardWeight) <=
+    static_cast<int>(PackedBoard::PositionMask))) ? 1 : -1];
+
+/// <summary> A sub-board with a mask of the positions it occupies. </summary>
+struct PackedSubBoard
+{
+  PackedSubBoard() : weights(), mask() {}
+  explicit PackedSubBoard(const PackedBoard& weights_)
+    : weights(weights_),
+      mask()
+  {
+    // Spread any set bit of a position across all of its bits.
+    const unsigned long long lowBits = 0x1111111111111111ULL;
+    for (int word = 0; word < PackedBoard::Words; ++word)
     {
-      return BoardHashKey(board);
+      const unsigned long long w = weights.words[word];
+      mask.words[word] = ((w | (w >> 1) | (w >> 2) | (w >> 3)) & lowBits) *
+                         PackedBoard::PositionMask;
     }
-  };
+  }
 
-  BoardEvaluationReachableWinStates(const State::Turn who_)
-    : who(who_),
-      redWinStates(),
-      totalRedWinStates(0),
-      blueWinStates(),
-      totalBlueWinStates(0)
+  /// <summary> Test if every weight of the sub-board is on the board. </summary>
+  inline bool ContainedIn(const PackedBoard& board) const
   {
-    State initState;
-    InitState(&initState);
-    // Get states where blue wins. These are all states where the board is
-    // balanced with one weight left.
+    bool contained = true;
+    for (int word = 0; word < PackedBoard::Words; ++word)
     {
-      blueWinStates.push_back(NumWeightsWinStates());
-      NumWeightsWinStates& singleWinStates = blueWinStates.back();
-      singleWinStates.numWeights = 1;
-      BoardHashList& states = singleWinStates.states;
-      BoardHashStorageAdapter adapter;
-      detail::ConflictBoard exclFunc(initState.board);
-      detail::SingleWeightStates(&states, &adapter, &exclFunc);
-      std::sort(states.begin(), states.end());
-      HPS_NTG_ASSERT_BOARD_HASH_NO_DUPS(states);
-      totalBlueWinStates = static_cast<int>(states.size());
+      contained &= ((board.words[word] & mask.words[word]) ==
+                    weights.words[word]);
     }
-    // Get states where red wins. These are all states with two weights where
-    // the removal of either weight is suicidal.
+    return contained;
+  }
+
+  PackedBoard weights;
+  PackedBoard mask;
+};
+
+namespace detail
+{
+/// <summary> Test a stable board for tipping on removal of any weight. </summary>
+inline bool AllRemovalsTip(const int count, const int* positions, Board* board)
+{
+  assert(positions && board);
+  for (const int* pos = positions; pos != (positions + count); ++pos)
+  {
+    Weight& w = (*board)[*pos];
+    const Weight tmpW = w;
+    w = Board::Empty;
+    const bool tipped = Tipped(*board);
+    w = tmpW;
+    if (!tipped)
     {
-      redWinStates.push_back(NumWeightsWinStates());
-      NumWeightsWinStates& doubleWinStates = redWinStates.back();
-      doubleWinStates.numWeights = 2;
-      BoardHashList& states = doubleWinStates.states;
-      BoardHashStorageAdapter adapter;
-      detail::DoubleWeightWinStateHelper exclFunc(initState.board);
-      detail::DoubleWeightStates(&states, &adapter, &exclFunc);
-      std::sort(states.begin(), states.end());
-      HPS_NTG_ASSERT_BOARD_HASH_NO_DUPS(states);
-      totalRedWinStates = static_cast<int>(states.size());
+      return false;
     }
   }
+  return true;
+}
 
-  /// <summary> Gather the occupied positions from a board. </summary>
-  static void CollectOccupiedPositions(const Board& board,
-                                       int* positionsOccupied,
-                                       int* positions)
+/// <summary> Stability tests of many sub-boards in lockstep. </summary>
+/// <remarks>
+///   <para> The torque of a sub-board about either pivot is the sum of the
+///     contributions of its members, so testing the removal of a member is
+///     a single subtraction. Lanes are laid out as structures of arrays and
+///     tested in branch-free loops that the compiler vectorizes.
+///   </para>
+/// </remarks>
+struct SubsetTorqueBatch
+{
+  enum { Lanes = 64, };
+  enum { BaseTorqueL = (Board::PivotL - Board::CenterOfGravity) *
+                       Board::BoardWeight, };
+  enum { BaseTorqueR = (Board::PivotR - Board::CenterOfGravity) *
+                       Board::BoardWeight, };
+
+  explicit SubsetTorqueBatch(const int numMembers_)
+    : numMembers(numMembers_),
+      lanes(0),
+      memberL(numMembers_ * Lanes, 0),
+      memberR(numMembers_ * Lanes, 0),
+      memberSlots(numMembers_ * Lanes, 0)
   {
-    assert(positionsOccupied);
-    assert(positions);
-    *positionsOccupied = 0;
-    int *posOut = positions;
-    int pos = -Board::Size;
-    for (Board::const_iterator w = board.begin(); w != board.end(); ++w, ++pos)
+    memset(torqueL, 0, sizeof(torqueL));
+    memset(torqueR, 0, sizeof(torqueR));
+    memset(keys, 0, sizeof(keys));
+  }
+
+  /// <summary> Torque contributions of the weight at pos. </summary>
+  static inline void Contributions(const int pos, const Weight w,
+                                   int* contribL, int* contribR)
+  {
+    assert(contribL && contribR);
+    *contribL = w * (Board::PivotL - pos);
+    *contribR = w * (Board::PivotR - pos);
+  }
+
+  inline bool Full() const
+  {
+    return Lanes == lanes;
+  }
+  inline void Clear()
+  {
+    lanes = 0;
+  }
+
+  /// <summary> Add the sub-board made of the given slots. </summary>
+  inline void Add(const size_t* cmb,
+                  const int* slotTorqueL,
+                  const int* slotTorqueR,
+                  const unsigned long long key)
+  {
+    assert(cmb);
+    assert(!Full());
+    int sumL = BaseTorqueL;
+    int sumR = BaseTorqueR;
+    for (int member = 0; member < numMembers; ++member)
     {
-      if (Board::Empty != *w)
-      {
-        *posOut = pos;
-        ++posOut;
-        ++(*positionsOccupied);
-      }
+      const int slot = static_cast<int>(cmb[member]);
+      const int laneIdx = (member * Lanes) + lanes;
+      memberL[laneIdx] = slotTorqueL[slot];
+      memberR[laneIdx] = slotTorqueR[slot];
+      memberSlots[laneIdx] = slot;
+      sumL += slotTorqueL[slot];
+      sumR += slotTorqueR[slot];
     }
+    torqueL[lanes] = sumL;
+    torqueR[lanes] = sumR;
+    keys[lanes] = key;
+    ++lanes;
   }
 
-  /// <summary> Count blue win states reachable from the given board. </summary>
-  int WinStatesReachable(const Board& board, const WinStateList& winStates) const
+  /// <summary> Get a mask of the lanes that hold stable sub-boards which
+  ///   tip on the removal of any member.
+  /// </summary>
+  unsigned long long WinStateLanes() const
   {
-    int count = 0;
-    int positionsOccupied;
-    int positions[Board::Positions];
-    CollectOccupiedPositions(board, &positionsOccupied, positions);
-    Combination cmb;
-    std::pair<int, int> posWeightPairs[Board::Positions];
-    unsigned long long m;
-    // Find all win states included in the board.
-    for (WinStateList::const_iterator winState = winStates.begin();
-         winState != winStates.end();
-         ++winState)
+    unsigned char win[Lanes];
+    for (int lane = 0; lane < Lanes; ++lane)
     {
-      // Are there enough weights to satisfy these win states?
-      const int numWeights = winState->numWeights;
-      if (positionsOccupied < numWeights)
-      {
-        continue;
-      }
-      // See if any of the win states are reachable. Make combinations of
-      // the filled board positions.
-      const BoardHashList& states = winState->states;
-      FastCombinationIterator cmbIter(positionsOccupied, numWeights, 0ULL);
-      const int numCmb = static_cast<int>(cmbIter.GetCombinationCount());
-      for (int cmbIdx = 0; cmbIdx < numCmb; ++cmbIdx)
+      win[lane] = (torqueL[lane] <= 0) & (torqueR[lane] >= 0);
+    }
+    for (int member = 0; member < numMembers; ++member)
+    {
+      const int* mL = &memberL[member * Lanes];
+      const int* mR = &memberR[member * Lanes];
+      for (int lane = 0; lane < Lanes; ++lane)
       {
-        // Get next combination and collect board pairs.
-        cmbIter.Next(&m, &cmb);
-        {
-          std::pair<int, int>* posWeightPair = posWeightPairs;
-          for (int cmbEleIdx = 0;
-               cmbEleIdx < numWeights;
-               ++cmbEleIdx, ++posWeightPair)
-          {
-            const int pos = positions[cmb[cmbEleIdx]];
-            posWeightPair->first = pos;
-            posWeightPair->second = board[pos];
-          }
-        }
-        // See if this board is a win state.
-        const BoardHashKey boardKey(HashPosWeightPairsCRC(numWeights,
-                                                          posWeightPairs));
-        const bool winState = std::binary_search(states.begin(),
-                                                 states.end(),
-                                                 boardKey);
-        count += winState;
+        win[lane] &= ((torqueL[lane] - mL[lane]) > 0) |
+                     ((torqueR[lane] - mR[lane]) < 0);
       }
     }
-    return count;
+    unsigned long long mask = 0ULL;
+    for (int lane = 0; lane < lanes; ++lane)
+    {
+      mask |= static_cast<unsigned long long>(win[lane]) << lane;
+    }
+    return mask;
   }
 
-  /// <summary> Compute win states from the current state. </summary>
-  void Update(const State& state,
-              const int invDepthBegin,
-              const int invDepthEnd)
-  {
-    assert(invDepthBegin < invDepthEnd);
-    const Board& currentBoard = state.board;
+  int numMembers;
+  int lanes;
+  int torqueL[Lanes];
+  int torqueR[Lanes];
+  unsigned long long keys[Lanes];
+  /// <summary> Per member rows of per lane values. </summary>
+  std::vector<int> memberL;
+  std::vector<int> memberR;
+  std::vector<int> memberSlots;
+};
+typedef char SubsetTorqueBatchLaneCheck[
+  (SubsetTorqueBatch::Lanes <= 64) ? 1 : -1];
 
-    // Enumerate all possible combinations of weights at depth.
-    int positionsOccupied;
-    int positions[Board::Positions];
-    CollectOccupiedPositions(currentBoard, &positionsOccupied, positions);
-    Combination cmb;
-    unsigned long long m;
+}
+
+/// <summary> Get all stable states with numWeights weights where the removal
+///   of any weight is suicidal and that do not conflict with the given board.
+/// </summary>
+/// <remarks>
+///   <para> Every placement of weights [1, Player::NumWeights] on every
+///     combination of positions is tested, so this is meant for offline
+///     table generation with small numWeights. The explicit states are in
+///     no particular order.
+///   </para>
+/// </remarks>
+inline int WinStatesNoConflict(const Board& conflictBoard,
+                               const int numWeights,
+                               std::vector<BoardHashKey>* set,
+                               std::vector<PackedSubBoard>* packedStates)
+{
+  assert(set && packedStates);
+  assert(numWeights > 0);
+
+  const detail::ConflictBoard conflictFunc(conflictBoard);
+  const RandomAccessLexicographicCombinations posCmbs(Board::Positions,
+                                                      numWeights);
+  const int posCmbCount = static_cast<int>(posCmbs.GetCombinationCount());
+  std::vector<std::vector<BoardHashKey> > threadSets(omp_get_max_threads());
+  std::vector<std::vector<PackedSubBoard> > threadPacked(omp_get_max_threads());
+#pragma omp parallel
+  {
+    std::vector<BoardHashKey>& threadSet = threadSets[omp_get_thread_num()];
+    std::vector<PackedSubBoard>& threadStates =
+      threadPacked[omp_get_thread_num()];
+    Combination posCmb;
+    std::vector<int> positions(numWeights);
+    std::vector<Weight> weights(numWeights);
     Board testBoard;
     ClearBoard(&testBoard);
-    for (int invDepth = invDepthBegin;
-         (invDepth != invDepthEnd) && (positionsOccupied >= invDepth);
-         ++invDepth)
+#pragma omp for schedule(dynamic, 16)
+    for (int posCmbIdx = 0; posCmbIdx < posCmbCount; ++posCmbIdx)
     {
-      // Blue wins at odd depths and red at even.
-      WinStateList* winStates;
-      int* winStateCount;
-      if (invDepth & 1)
-      {
-        winStates = &blueWinStates;
-        winStateCount = &totalBlueWinStates;
-      }
-      else
+      posCmbs.GetCombination(posCmbIdx, &posCmb);
+      for (int wIdx = 0; wIdx < numWeights; ++wIdx)
       {
-        winStates = &redWinStates;
-        winStateCount = &totalRedWinStates;
+        positions[wIdx] = static_cast<int>(posCmb[wIdx]) - Board::Size;
       }
-      // See if we have computed for this depth.
-      for (WinStateList::iterator chkDepth = winStates->begin();
-           chkDepth != winStates->end();
-           ++chkDepth)
+      // Step through the weights like an odometer.
+      std::fill(weights.begin(), weights.end(), 1);
+      for (;;)
       {
-        if (chkDepth->numWeights == invDepth)
+        for (int wIdx = 0; wIdx < numWeights; ++wIdx)
         {
-          *winStateCount -= chkDepth->states.size();
-          winStates->erase(chkDepth);
-          break;
+          testBoard[positions[wIdx]] = weights[wIdx];
         }
-      }
-      winStates->push_back(NumWeightsWinStates());
-      NumWeightsWinStates& depthState = winStates->back();
-      depthState.numWeights = invDepth;
-      BoardHashList& states = depthState.states;
-      // Enumerate the board weight combinations.
-      FastCombinationIterator cmbIter(positionsOccupied, invDepth, 0);
-      const int cmbCount = static_cast<int>(cmbIter.GetCombinationCount());
-      for (int cmbIdx = 0; cmbIdx < cmbCount; ++cmbIdx)
-      {
-        cmbIter.Next(&m, &cmb);
-        // Build the board;
-        for (Combination::const_iterator cmbEle = cmb.begin();
-             cmbEle != cmb.end();
-             ++cmbEle)
+        if (!conflictFunc(testBoard) &&
+            !Tipped(testBoard) &&
+            detail::AllRemovalsTip(numWeights, &positions[0], &testBoard))
         {
-          const int pos = positions[*cmbEle];
-          assert(Board::Empty == testBoard[pos]);
-          testBoard[pos] = currentBoard[pos];
+          threadSet.push_back(BoardHashKey(testBoard));
+          threadStates.push_back(PackedSubBoard(PackedBoard(testBoard)));
         }
-        const bool stable = !Tipped(testBoard);
-        if (stable)
+        int wheel = numWeights - 1;
+        while ((wheel >= 0) && (Player::NumWeights == weights[wheel]))
         {
-          // See if I can't remove a weight.
-          bool winState = true;
-          for (Combination::const_iterator cmbEle = cmb.begin();
-               cmbEle != cmb.end();
-               ++cmbEle)
-          {
-            const int pos = positions[*cmbEle];
-            testBoard[pos] = Board::Empty;
-            const bool tipped = Tipped(testBoard);
-            testBoard[pos] = currentBoard[pos];
-            if (!tipped)
-            {
-              winState = false;
-              break;
-            }
-          }
-          if (winState)
-          {
-            states.push_back(BoardHashKey(testBoard));
-            ++(*winStateCount);
-          }
+          weights[wheel] = 1;
+          --wheel;
         }
-        // Reset the board.
-        for (Combination::const_iterator cmbEle = cmb.begin();
-             cmbEle != cmb.end();
-             ++cmbEle)
+        if (wheel < 0)
         {
-          const int pos = positions[*cmbEle];
-          assert(Board::Empty != testBoard[pos]);
-          testBoard[pos] = Board::Empty;
+          break;
         }
+        ++weights[wheel];
       }
-      if (!states.empty())
+      for (int wIdx = 0; wIdx < numWeights; ++wIdx)
       {
-        std::sort(states.begin(), states.end());
-        HPS_NTG_ASSERT_BOARD_HASH_NO_DUPS(states);
-      }
-      else
-      {
-        winStates->pop_back();
+        testBoard[positions[wIdx]] = Board::Empty;
       }
     }
   }
+  set->clear();
+  packedStates->clear();
+  for (size_t threadIdx = 0; threadIdx < threadSets.size(); ++threadIdx)
+  {
+    const std::vector<BoardHashKey>& threadSet = threadSets[threadIdx];
+    set->insert(set->end(), threadSet.begin(), threadSet.end());
+    const std::vector<PackedSubBoard>& threadStates = threadPacked[threadIdx];
+    packedStates->insert(packedStates->end(),
+                         threadStates.begin(), threadStates.end());
+  }
+  return static_cast<int>(set->size());
+}
 
-  /// <summary> Score a board. </summary>
-  int operator()(const State& state) const
+struct BoardEvaluationReachableWinStates
+{
+  typedef std::vector<BoardHashKey> BoardHashList;
+  /// <summary> How a layer searches its sorted keys. </summary>
+  enum KeySearch
   {
-    assert(!Tipped(state.board));
+    /// <summary> std::binary_search over the sorted keys. </summary>
+    KeySearch_Binary = 0,
+    /// <summary> Branch-free search over the keys in BFS order. </summary>
+    KeySearch_Eytzinger,
+  };
 
-    // Count win states reachable.
-    const int redWinStatesReachable = WinStatesReachable(state.board,
-                                                         redWinStates);
-    const int blueWinStatesReachable = WinStatesReachable(state.board,
-                                                          blueWinStates);
-    // If we have no information about win states...
-    const bool blind = (redWinStatesReachable + blueWinStatesReachable) > 0;
-    int score;
-    // I am red?
-    if (State::Turn_Red == who)
+  struct NumWeightsWinStates
+  {
+    enum { FilterBitsPerState = 16, };
+    /// <summary> Keys per cache line, also the Eytzinger prefetch stride. </summary>
+    enum { KeysPerLine = 64 / sizeof(BoardHashKey), };
+    typedef char KeysPerLineCheck[
+      (0 == (KeysPerLine & (KeysPerLine - 1))) ? 1 : -1];
+
+    enum { TouchingSlots = Board::Positions * detail::PosWeightKeys::Weights, };
+
+    NumWeightsWinStates()
+      : numWeights(0),
+        states(),
+        filter(),
+        filterShift(58),
+        mappedStates(NULL),
+        mappedStateCount(0),
+        mappedFilter(NULL),
+        mappedFilterWords(0),
+        packedStates(),
+        touchingBegin(),
+        touching(),
+        mappedPackedStates(NULL),
+        mappedTouchingBegin(NULL),
+        mappedTouching(NULL),
+        eytzinger()
+    {}
+
+    /// <summary> Sort the states and build the membership filter. </summary>
+    /// <remarks>
+    ///   <para> Searches use binary search until SetKeySearch() picks
+    ///     another mode, so the Eytzinger copy is only built when used.
+    ///   </para>
+    /// </remarks>
+    void Finalize()
     {
-      score = redWinStatesReachable - blueWinStatesReachable;
-      if (blind)
+      std::sort(states.begin(), states.end());
+      HPS_NTG_ASSERT_BOARD_HASH_NO_DUPS(states);
+      // Size the filter to a power of two with several bits per state.
+      int filterBits = 6;
+      while ((1ULL << filterBits) <
+             (FilterBitsPerState * static_cast<unsigned long long>(states.size())))
       {
-        score = -blueWinStatesReachable;
+        ++filterBits;
+      }
+      filterShift = 64 - filterBits;
+      filter.assign(1ULL << (filterBits - 6), 0ULL);
+      for (BoardHashList::const_iterator state = states.begin();
+           state != states.end();
+           ++state)
+      {
+        const unsigned long long filterIdx = state->key >> filterShift;
+        filter[filterIdx >> 6] |= (1ULL << (filterIdx & 63));
       }
+      BoardHashList().swap(eytzinger);
     }
-    // I am blue.
-    else
+
+    /// <summary> Build or drop the Eytzinger copy of the keys. </summary>
+    void SetKeySearch(const KeySearch keySearch)
     {
-      score = blueWinStatesReachable - redWinStatesReachable;
-      if (blind)
+      if (KeySearch_Binary == keySearch)
       {
-        score = -redWinStatesReachable;
+        BoardHashList().swap(eytzinger);
+        return;
       }
+      // Slot 0 is unused so that the children of slot k are 2k and 2k + 1.
+      const size_t n = Size();
+      eytzinger.assign(n + 1, BoardHashKey(0ULL));
+      size_t sortedIdx = 0;
+      FillEytzinger(Begin(), n, 1, &sortedIdx);
+      assert(n == sortedIdx);
     }
-    return score;
-  }
 
-  /// <summary> The player for whom we evaluate the board state. </sumamry>
-  State::Turn who;
-  /// <summary> List of red win states. </summary>
-  WinStateList redWinStates;
-  int totalRedWinStates;
-  /// <summary> List of blue win states. </summary>
-  WinStateList blueWinStates;
-  int totalBlueWinStates;
+    /// <summary> Place the sorted keys in BFS order by an in-order walk. </summary>
+    void FillEytzinger(const BoardHashKey* sorted,
+                       const size_t n,
+                       const size_t k,
+                       size_t* sortedIdx)
+    {
+      if (k <= n)
+      {
+        FillEytzinger(sorted, n, 2 * k, sortedIdx);
+        eytzinger[k] = sorted[(*sortedIdx)++];
+        FillEytzinger(sorted, n, (2 * k) + 1, sortedIdx);
+      }
+    }
+
+    /// <summary> Search the Eytzinger copy of the keys. </summary>
+    inline bool EytzingerContains(const BoardHashKey& boardKey) const
+    {
+      const size_t n = eytzinger.size() - 1;
+      const BoardHashKey* keys = &eytzinger[0];
+      size_t k = 1;
+      while (k <= n)
+      {
+        // The descendants log2(KeysPerLine) levels down, three for 8-byte
+        // keys, are the KeysPerLine consecutive slots from KeysPerLine * k.
+        // That is one cache line of keys, fetched while this level and the
+        // two below it are compared.
+        const size_t prefetchIdx = KeysPerLine * k;
+        if (prefetchIdx <= n)
+        {
+          HPS_NTG_PREFETCH(keys + prefetchIdx);
+        }
+        k = (2 * k) + (keys[k] < boardKey);
+      }
+      // Undo the right turns taken after the last left turn, which was at
+      // the smallest key not less than boardKey.
+      while (k & 1)
+      {
+        k >>= 1;
+      }
+      k >>= 1;
+      return (0 != k) && (keys[k] == boardKey);
+    }
+
+    /// <summary> Exchange contents without copying the states. </summary>
+    void Swap(NumWeightsWinStates& other)
+    {
+      std::swap(numWeights, other.numWeights);
+      states.swap(other.states);
+      filter.swap(other.filter);
+      std::swap(filterShift, other.filterShift);
+      std::swap(mappedStates, other.mappedStates);
+      std::swap(mappedStateCount, other.mappedStateCount);
+      std::swap(mappedFilter, other.mappedFilter);
+      std::swap(mappedFilterWords, other.mappedFilterWords);
+      packedStates.swap(other.packedStates);
+      touchingBegin.swap(other.touchingBegin);
+      touching.swap(other.touching);
+      std::swap(mappedPackedStates, other.mappedPackedStates);
+      std::swap(mappedTouchingBegin, other.mappedTouchingBegin);
+      std::swap(mappedTouching, other.mappedTouching);
+      eytzinger.swap(other.eytzinger);
+    }
+
+    /// <summary> Use a prebuilt layer in place of generated states. </summary>
+    /// <remarks>
+    ///   <para> The explicit states and touching index are mapped as well,
+    ///     so a mapped layer needs no probing or indexing.
+    ///   </para>
+    /// </remarks>
+    void Map(const WinStateTable::Layer& layer)
+    {
+      numWeights = layer.numWeights;
+      states.clear();
+      filter.clear();
+      filterShift = layer.filterShift;
+      mappedStates = reinterpret_cast<const BoardHashKey*>(layer.states);
+      mappedStateCount = layer.stateCount;
+      mappedFilter = layer.filter;
+      mappedFilterWords = layer.filterWords;
+      packedStates.clear();
+      touchingBegin.clear();
+      touching.clear();
+      mappedPackedStates =
+        reinterpret_cast<const PackedSubBoard*>(layer.packedStates);
+      mappedTouchingBegin = layer.touchingBegin;
+      mappedTouching = layer.touching;
+      BoardHashList().swap(eytzinger);
+    }
+
+    /// <summary> Describe the layer for writing to a table file. </summary>
+    WinStateTable::Layer GetTableLayer() const
+    {
+      WinStateTable::Layer layer;
+      layer.numWeights = numWeights;
+      layer.filterShift = filterShift;
+      layer.states = reinterpret_cast<const unsigned long long*>(Begin());
+      layer.stateCount = Size();
+      layer.filter = FilterBegin();
+      layer.filterWords = mappedStates ? mappedFilterWords : filter.size();
+      assert(HasTouchingIndex());
+      layer.packedStates =
+        reinterpret_cast<const unsigned long long*>(PackedBegin());
+      layer.touchingBegin = TouchingBeginData();
+      layer.touching = TouchingData();
+      layer.touchingCount = layer.touchingBegin[TouchingSlots];
+      return layer;
+    }
+
+    inline size_t Size() const
+    {
+      return mappedStates ? mappedStateCount : states.size();
+    }
+    inline const BoardHashKey* Begin() const
+    {
+      if (mappedStates)
+      {
+        return mappedStates;
+      }
+      return states.empty() ? NULL : &states[0];
+    }
+    inline const BoardHashKey* End() const
+    {
+      return Begin() + Size();
+    }
+    inline const unsigned long long* FilterBegin() const
+    {
+      if (mappedStates)
+      {
+        return mappedFilter;
+      }
+      return filter.empty() ? NULL : &filter[0];
+    }
+    inline size_t PackedSize() const
+    {
+      return mappedPackedStates ? mappedStateCount : packedStates.size();
+    }
+    inline const PackedSubBoard* PackedBegin() const
+    {
+      if (mappedPackedStates)
+      {
+        return mappedPackedStates;
+      }
+      return packedStates.empty() ? NULL : &packedStates[0];
+    }
+    inline const PackedSubBoard* PackedEnd() const
+    {
+      return PackedBegin() + PackedSize();
+    }
+    inline bool HasTouchingIndex() const
+    {
+      return mappedTouchingBegin || !touchingBegin.empty();
+    }
+    inline const unsigned int* TouchingBeginData() const
+    {
+      if (mappedTouchingBegin)
+      {
+        return mappedTouchingBegin;
+      }
+      return touchingBegin.empty() ? NULL : &touchingBegin[0];
+    }
+    inline const unsigned int* TouchingData() const
+    {
+      if (mappedTouching)
+      {
+        return mappedTouching;
+      }
+      return touching.empty() ? NULL : &touching[0];
+    }
+
+    /// <summary> Recover the explicit states of a layer from its keys. </summary>
+    /// <remarks>
+    ///   <para> Probes every placement of one or two weights, so this is
+    ///     only for the layers built at construction. Larger layers record
+    ///     their explicit states as they are generated in Update().
+    ///   </para>
+    /// </remarks>
+    void ProbePackedStates()
+    {
+      assert((numWeights > 0) && (numWeights <= 2));
+      packedStates.clear();
+      packedStates.reserve(Size());
+      PackedBoard board;
+      for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+      {
+        for (Weight w = 1; w <= Player::NumWeights; ++w)
+        {
+          board.Set(pos, w);
+          const unsigned long long key = HashPosWeight(pos, w);
+          if (1 == numWeights)
+          {
+            if (Contains(BoardHashKey(key)))
+            {
+              packedStates.push_back(PackedSubBoard(board));
+            }
+          }
+          else
+          {
+            for (int pos2 = pos + 1; pos2 <= Board::Size; ++pos2)
+            {
+              for (Weight w2 = 1; w2 <= Player::NumWeights; ++w2)
+              {
+                if (Contains(BoardHashKey(key ^ HashPosWeight(pos2, w2))))
+                {
+                  board.Set(pos2, w2);
+                  packedStates.push_back(PackedSubBoard(board));
+                  board.Set(pos2, Board::Empty);
+                }
+              }
+            }
+          }
+        }
+        board.Set(pos, Board::Empty);
+      }
+      assert(packedStates.size() == Size());
+    }
+
+    /// <summary> Index the explicit states by each (position, weight) they
+    ///   contain.
+    /// </summary>
+    void BuildTouchingIndex()
+    {
+      touchingBegin.assign(TouchingSlots + 1, 0U);
+      // Count states per slot, then turn counts into offsets.
+      for (std::vector<PackedSubBoard>::const_iterator state = packedStates.begin();
+           state != packedStates.end();
+           ++state)
+      {
+        for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+        {
+          const Weight w = state->weights.Get(pos);
+          if (Board::Empty != w)
+          {
+            ++touchingBegin[TouchingSlot(pos, w) + 1];
+          }
+        }
+      }
+      for (int slot = 0; slot < TouchingSlots; ++slot)
+      {
+        touchingBegin[slot + 1] += touchingBegin[slot];
+      }
+      touching.resize(touchingBegin[TouchingSlots]);
+      std::vector<unsigned int> slotFill(touchingBegin.begin(),
+                                         touchingBegin.end() - 1);
+      for (size_t stateIdx = 0; stateIdx < packedStates.size(); ++stateIdx)
+      {
+        const PackedSubBoard& state = packedStates[stateIdx];
+        for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+        {
+          const Weight w = state.weights.Get(pos);
+          if (Board::Empty != w)
+          {
+            touching[slotFill[TouchingSlot(pos, w)]++] =
+              static_cast<unsigned int>(stateIdx);
+          }
+        }
+      }
+    }
+
+    static inline int TouchingSlot(const int pos, const Weight w)
+    {
+      return ((pos + Board::Size) * detail::PosWeightKeys::Weights) + w;
+    }
+
+    /// <summary> Count states containing weight w at pos that are on the
+    ///   board.
+    /// </summary>
+    inline int CountTouching(const int pos,
+                             const Weight w,
+                             const PackedBoard& board) const
+    {
+      assert(HasTouchingIndex());
+      const unsigned int* slotBegin = TouchingBeginData();
+      const unsigned int* slotStates = TouchingData();
+      const PackedSubBoard* layerStates = PackedBegin();
+      const int slot = TouchingSlot(pos, w);
+      const unsigned int idxEnd = slotBegin[slot + 1];
+      int count = 0;
+      for (unsigned int idx = slotBegin[slot]; idx < idxEnd; ++idx)
+      {
+        count += layerStates[slotStates[idx]].ContainedIn(board);
+      }
+      return count;
+    }
+
+    /// <summary> Test if the key is one of the states. </summary>
+    inline bool Contains(const BoardHashKey& boardKey) const
+    {
+      // Keys are uniformly random, so the high bits reject most misses
+      // before paying for a search.
+      assert(FilterBegin());
+      const unsigned long long filterIdx = boardKey.key >> filterShift;
+      if (0 == (FilterBegin()[filterIdx >> 6] & (1ULL << (filterIdx & 63))))
+      {
+        return false;
+      }
+      if (!eytzinger.empty())
+      {
+        return EytzingerContains(boardKey);
+      }
+      return std::binary_search(Begin(), End(), boardKey);
+    }
+
+    int numWeights;
+    BoardHashList states;
+    /// <summary> Bitmap over the high bits of the state keys. </summary>
+    std::vector<unsigned long long> filter;
+    int filterShift;
+    /// <summary> Prebuilt states and filter used in place when set. </summary>
+    const BoardHashKey* mappedStates;
+    size_t mappedStateCount;
+    const unsigned long long* mappedFilter;
+    size_t mappedFilterWords;
+    /// <summary> Explicit states in no particular order. </summary>
+    std::vector<PackedSubBoard> packedStates;
+    /// <summary> Offsets into touching for each (position, weight). </summary>
+    std::vector<unsigned int> touchingBegin;
+    /// <summary> Indices of packedStates grouped by (position, weight). </summary>
+    std::vector<unsigned int> touching;
+    /// <summary> Prebuilt explicit states and touching index used in place
+    ///   when set.
+    /// </summary>
+    const PackedSubBoard* mappedPackedStates;
+    const unsigned int* mappedTouchingBegin;
+    const unsigned int* mappedTouching;
+    /// <summary> Keys in BFS order from slot 1, empty to use binary search. </summary>
+    BoardHashList eytzinger;
+  };
+  typedef std::vector<NumWeightsWinStates> WinStateList;
+
+  /// <summary> Largest number of weights in a layer. </summary>
+  enum { MaxLayerWeights = Board::Positions, };
+
+  /// <summary> A layer requested by Update() and built on demand. </summary>
+  struct RequestedLayer
+  {
+    RequestedLayer() : source(), layer() {}
+
+    /// <summary> The board whose sub-boards make up the layer. </summary>
+    Board source;
+    NumWeightsWinStates layer;
+  };
+
+  /// <summary> The layers of both colors available to one scoring. </summary>
+  struct LayerSnapshot
+  {
+    enum { MaxLayers = MaxLayerWeights + 1, };
+
+    const NumWeightsWinStates* red[MaxLayers];
+    int numRed;
+    const NumWeightsWinStates* blue[MaxLayers];
+    int numBlue;
+    /// <summary> Mask of the requested layers that were built. </summary>
+    unsigned long long built;
+    unsigned int generation;
+  };
+
+  /// <summary> Direct-mapped cache of board scores for one thread. </summary>
+  /// <remarks>
+  ///   <para> Entries are tagged with the win state generation that scored
+  ///     them so that Update() invalidates every cache in O(1). Storage is
+  ///     allocated by the owning thread on first use.
+  ///   </para>
+  /// </remarks>
+  struct EvalCache
+  {
+    enum { EntriesLog2 = 14, };
+    enum { Entries = 1 << EntriesLog2, };
+
+    struct Entry
+    {
+      unsigned long long key;
+      unsigned int generation;
+      int score;
+    };
+
+    EvalCache() : entries(), hits(0ULL), misses(0ULL) {}
+
+    inline Entry* Lookup(const unsigned long long key)
+    {
+      if (entries.empty())
+      {
+        Entry emptyEntry = { 0ULL, 0U, 0 };
+        entries.assign(Entries, emptyEntry);
+      }
+      return &entries[key & (Entries - 1)];
+    }
+
+    std::vector<Entry> entries;
+    unsigned long long hits;
+    unsigned long long misses;
+  };
+
+  /// <summary> How a board missing from the cache is scored. </summary>
+  enum EvalMode
+  {
+    /// <summary> Count the win states among all subsets of the board. </summary>
+    EvalMode_Recount = 0,
+    /// <summary> Adjust the counts of the previously scored board. </summary>
+    EvalMode_Incremental,
+    /// <summary> Estimate the counts from random subsets of the board. </summary>
+    EvalMode_Sampled,
+  };
+  /// <summary> Random subsets tested per layer by EvalMode_Sampled. </summary>
+  enum { DefaultSamplesPerLayer = 256, };
+
+  /// <summary> Reachable win state counts for the last board a thread
+  ///   scored.
+  /// </summary>
+  /// <remarks>
+  ///   <para> Successive leaves of a search differ by a few weights, so only
+  ///     the win states touching a changed position need to be tested.
+  ///   </para>
+  /// </remarks>
+  struct IncrementalCounts
+  {
+    IncrementalCounts()
+      : board(),
+        red(0),
+        blue(0),
+        generation(0U),
+        layers(0ULL)
+    {}
+
+    PackedBoard board;
+    int red;
+    int blue;
+    unsigned int generation;
+    /// <summary> Mask of the requested layers included in the counts. </summary>
+    unsigned long long layers;
+  };
+
+  /// <summary> Adapt boards to keys. </summary>
+  struct BoardHashStorageAdapter
+  {
+    inline BoardHashKey operator()(const Board& board) const
+    {
+      return BoardHashKey(board);
+    }
+  };
+
+  /// <summary> Set up the initial win states. </summary>
+  /// <remarks>
+  ///   <para> When a loaded table is given its single and double weight
+  ///     layers are used in place. Otherwise they are generated.
+  ///   </para>
+  /// </remarks>
+  explicit BoardEvaluationReachableWinStates(const State::Turn who_,
+                                             const WinStateTable* table = NULL)
+    : who(who_),
+      redWinStates(),
+      totalRedWinStates(0),
+      blueWinStates(),
+      totalBlueWinStates(0),
+      evalMode(EvalMode_Incremental),
+      samplesPerLayer(DefaultSamplesPerLayer),
+      keySearch(KeySearch_Eytzinger),
+      cacheGeneration(1U),
+      evalCaches(std::max(omp_get_num_procs(), omp_get_max_threads())),
+      incrementalCounts(evalCaches.size()),
+      backgroundLayers(false),
+      requestedLayers(0ULL),
+      builtLayers(0ULL),
+      cancelBackground(false),
+      backgroundThread()
+  {
+    ResetWinStates(table);
+  }
+
+  ~BoardEvaluationReachableWinStates()
+  {
+    StopBackgroundLayers();
+  }
+
+  /// <summary> Number of weights in the layers built at construction. </summary>
+  enum { InitialWinStateWeights = 2, };
+
+  /// <summary> Go back to the initial win states. </summary>
+  /// <remarks>
+  ///   <para> Layers requested by Update() are dropped, built or not, so the
+  ///     evaluator can be reused for a new game.
+  ///   </para>
+  /// </remarks>
+  void ResetWinStates(const WinStateTable* table)
+  {
+    StopBackgroundLayers();
+    requestedLayers = 0ULL;
+    builtLayers = 0ULL;
+    for (int numWeights = 1; numWeights <= MaxLayerWeights; ++numWeights)
+    {
+      requestedLayerList[numWeights].layer = NumWeightsWinStates();
+    }
+    redWinStates.clear();
+    totalRedWinStates = 0;
+    blueWinStates.clear();
+    totalBlueWinStates = 0;
+    if (!table || !MapWinStates(*table))
+    {
+      GenerateWinStates();
+    }
+    IndexInitialWinStates();
+    SetKeySearch(keySearch);
+    // Scores cached against the old win states are stale.
+    ++cacheGeneration;
+  }
+
+  /// <summary> Use the layers of a prebuilt table. </summary>
+  /// <remarks>
+  ///   <para> Layers larger than the initial ones hold the win states that
+  ///     do not conflict with the initial board. They score boards until
+  ///     Update() replaces them with the win states of the current board.
+  ///   </para>
+  /// </remarks>
+  bool MapWinStates(const WinStateTable& table)
+  {
+    const WinStateTable::LayerList& layers = table.GetLayers();
+    WinStateList mappedRed;
+    WinStateList mappedBlue;
+    int mappedRedCount = 0;
+    int mappedBlueCount = 0;
+    int initialLayers = 0;
+    for (WinStateTable::LayerList::const_iterator layer = layers.begin();
+         layer != layers.end();
+         ++layer)
+    {
+      if (layer->numWeights <= InitialWinStateWeights)
+      {
+        ++initialLayers;
+      }
+      // Blue wins at odd depths and red at even.
+      WinStateList* winStates;
+      int* winStateCount;
+      if (layer->numWeights & 1)
+      {
+        winStates = &mappedBlue;
+        winStateCount = &mappedBlueCount;
+      }
+      else
+      {
+        winStates = &mappedRed;
+        winStateCount = &mappedRedCount;
+      }
+      winStates->push_back(NumWeightsWinStates());
+      winStates->back().Map(*layer);
+      *winStateCount += static_cast<int>(layer->stateCount);
+    }
+    if (InitialWinStateWeights != initialLayers)
+    {
+      return false;
+    }
+    redWinStates.swap(mappedRed);
+    totalRedWinStates = mappedRedCount;
+    blueWinStates.swap(mappedBlue);
+    totalBlueWinStates = mappedBlueCount;
+    return true;
+  }
+
+  /// <summary> Build the incremental index of the initial layers. </summary>
+  void IndexInitialWinStates()
+  {
+    WinStateList* lists[] = { &redWinStates, &blueWinStates };
+    for (int listIdx = 0; listIdx < 2; ++listIdx)
+    {
+      for (WinStateList::iterator winState = lists[listIdx]->begin();
+           winState != lists[listIdx]->end();
+           ++winState)
+      {
+        // Mapped layers come with their index.
+        if (!winState->HasTouchingIndex())
+        {
+          winState->ProbePackedStates();
+          winState->BuildTouchingIndex();
+        }
+      }
+    }
+  }
+
+  /// <summary> Generate the single and double weight layers. </summary>
+  void GenerateWinStates()
+  {
+    State initState;
+    InitState(&initState);
+    // Get states where blue wins. These are all states where the board is
+    // balanced with one weight left.
+    {
+      blueWinStates.push_back(NumWeightsWinStates());
+      NumWeightsWinStates& singleWinStates = blueWinStates.back();
+      singleWinStates.numWeights = 1;
+      BoardHashList& states = singleWinStates.states;
+      BoardHashStorageAdapter adapter;
+      detail::ConflictBoard exclFunc(initState.board);
+      detail::SingleWeightStates(&states, &adapter, &exclFunc);
+      singleWinStates.Finalize();
+      totalBlueWinStates = static_cast<int>(states.size());
+    }
+    // Get states where red wins. These are all states with two weights where
+    // the removal of either weight is suicidal.
+    {
+      redWinStates.push_back(NumWeightsWinStates());
+      NumWeightsWinStates& doubleWinStates = redWinStates.back();
+      doubleWinStates.numWeights = 2;
+      BoardHashList& states = doubleWinStates.states;
+      BoardHashStorageAdapter adapter;
+      detail::DoubleWeightWinStateHelper exclFunc(initState.board);
+      detail::DoubleWeightStates(&states, &adapter, &exclFunc);
+      doubleWinStates.Finalize();
+      totalRedWinStates = static_cast<int>(states.size());
+    }
+  }
+
+  /// <summary> Gather the occupied positions from a board. </summary>
+  static void CollectOccupiedPositions(const Board& board,
+                                       int* positionsOccupied,
+                                       int* positions)
+  {
+    assert(positionsOccupied);
+    assert(positions);
+    *positionsOccupied = 0;
+    int *posOut = positions;
+    int pos = -Board::Size;
+    for (Board::const_iterator w = board.begin(); w != board.end(); ++w, ++pos)
+    {
+      if (Board::Empty != *w)
+      {
+        *posOut = pos;
+        ++posOut;
+        ++(*positionsOccupied);
+      }
+    }
+  }
+
+  /// <summary> Gather the keys of the weights at the occupied positions. </summary>
+  static void CollectOccupiedKeys(const Board& board,
+                                  const int positionsOccupied,
+                                  const int* positions,
+                                  unsigned long long* keys)
+  {
+    assert(positions);
+    assert(keys);
+    for (int posIdx = 0; posIdx < positionsOccupied; ++posIdx)
+    {
+      const int pos = positions[posIdx];
+      keys[posIdx] = HashPosWeight(pos, board[pos]);
+    }
+  }
+
+  /// <summary> Iterate combinations of occupied positions. </summary>
+  typedef FixedCombinationIterator<Board::Positions> SlotCombinationIterator;
+  /// <summary> Iterate combinations of occupied positions by single swaps. </summary>
+  typedef RevolvingDoorCombinationIterator<Board::Positions>
+    SlotRevolvingDoorIterator;
+
+  /// <summary> Get the key of a combination of occupied positions. </summary>
+  /// <remarks>
+  ///   <para> Keys are XOR-additive, so prefixKeys[i] holds the key of the
+  ///     first i members of the previous combination. Only the members from
+  ///     changeIdx on are folded again, which is amortized O(1) per step of
+  ///     a lexicographic enumeration.
+  ///   </para>
+  /// </remarks>
+  static unsigned long long CombinationKey(const size_t* cmb,
+                                           const unsigned int k,
+                                           unsigned int changeIdx,
+                                           const unsigned long long* slotKeys,
+                                           unsigned long long* prefixKeys)
+  {
+    assert(cmb && slotKeys && prefixKeys);
+    assert(changeIdx < k);
+    for (; changeIdx < k; ++changeIdx)
+    {
+      prefixKeys[changeIdx + 1] = prefixKeys[changeIdx] ^
+                                  slotKeys[cmb[changeIdx]];
+    }
+    return prefixKeys[k];
+  }
+
+  /// <summary> Count win states reachable from the given board. </summary>
+  /// <remarks>
+  ///   <para> Each layer is counted from whichever side is smaller: the
+  ///     subsets of the board are probed against the keys, or the explicit
+  ///     states are tested for containment in the board.
+  ///   </para>
+  /// </remarks>
+  static int WinStatesReachable(const Board& board,
+                                const NumWeightsWinStates* const* layers,
+                                const int numLayers)
+  {
+    int count = 0;
+    int positionsOccupied;
+    int positions[Board::Positions];
+    CollectOccupiedPositions(board, &positionsOccupied, positions);
+    unsigned long long slotKeys[Board::Positions];
+    CollectOccupiedKeys(board, positionsOccupied, positions, slotKeys);
+    const PackedBoard packedBoard(board);
+    // Find all win states included in the board.
+    for (int layerIdx = 0; layerIdx < numLayers; ++layerIdx)
+    {
+      const NumWeightsWinStates* winState = layers[layerIdx];
+      // Are there enough weights to satisfy these win states?
+      const int numWeights = winState->numWeights;
+      if (positionsOccupied < numWeights)
+      {
+        continue;
+      }
+      count += CountLayerStates(*winState, positionsOccupied, slotKeys,
+                                packedBoard);
+    }
+    return count;
+  }
+
+  /// <summary> Count the states of a layer from the cheaper direction. </summary>
+  static int CountLayerStates(const NumWeightsWinStates& winState,
+                              const int positionsOccupied,
+                              const unsigned long long* slotKeys,
+                              const PackedBoard& packedBoard)
+  {
+    const unsigned long long cmbCount = Choose(positionsOccupied,
+                                               winState.numWeights);
+    if (winState.PackedSize() < cmbCount)
+    {
+      return CountContainedStates(winState, packedBoard);
+    }
+    return CountSubsetStates(winState, positionsOccupied, slotKeys);
+  }
+
+  /// <summary> Estimate win states reachable from the given board. </summary>
+  /// <remarks>
+  ///   <para> Layers that can be counted exactly with no more than samples
+  ///     tests are counted exactly. The rest are estimated from samples
+  ///     random subsets of the board, so no layer costs more than samples
+  ///     tests however crowded the board is.
+  ///   </para>
+  ///   <para> The random subsets are seeded from the board key so that a
+  ///     board always gets the same estimate.
+  ///   </para>
+  /// </remarks>
+  static int WinStatesReachableSampled(const Board& board,
+                                       const NumWeightsWinStates* const* layers,
+                                       const int numLayers,
+                                       const int samples)
+  {
+    assert(samples > 0);
+    int count = 0;
+    int positionsOccupied;
+    int positions[Board::Positions];
+    CollectOccupiedPositions(board, &positionsOccupied, positions);
+    unsigned long long slotKeys[Board::Positions];
+    CollectOccupiedKeys(board, positionsOccupied, positions, slotKeys);
+    const PackedBoard packedBoard(board);
+    const unsigned long long boardKey = HashBoard(board);
+    for (int layerIdx = 0; layerIdx < numLayers; ++layerIdx)
+    {
+      const NumWeightsWinStates* winState = layers[layerIdx];
+      const int numWeights = winState->numWeights;
+      if (positionsOccupied < numWeights)
+      {
+        continue;
+      }
+      const unsigned long long cmbCount = Choose(positionsOccupied, numWeights);
+      const unsigned long long exactCost =
+        std::min(static_cast<unsigned long long>(winState->PackedSize()),
+                 cmbCount);
+      if (exactCost <= static_cast<unsigned long long>(samples))
+      {
+        count += CountLayerStates(*winState, positionsOccupied, slotKeys,
+                                  packedBoard);
+      }
+      else
+      {
+        // Layers of the same board draw different subsets.
+        unsigned long long seed =
+          boardKey ^ static_cast<unsigned long long>(numWeights);
+        count += CountSampledStates(*winState, positionsOccupied, slotKeys,
+                                    cmbCount, samples, &seed);
+      }
+    }
+    return count;
+  }
+
+  /// <summary> Estimate the states of a layer among the subsets of a board. </summary>
+  /// <remarks>
+  ///   <para> Each sample is a uniform random subset of numWeights occupied
+  ///     slots drawn with Floyd's algorithm. The fraction of samples that are
+  ///     win states is scaled by the number of subsets.
+  ///   </para>
+  /// </remarks>
+  static int CountSampledStates(const NumWeightsWinStates& winState,
+                                const int positionsOccupied,
+                                const unsigned long long* slotKeys,
+                                const unsigned long long cmbCount,
+                                const int samples,
+                                unsigned long long* seed)
+  {
+    assert(slotKeys && seed);
+    assert(samples > 0);
+    const int numWeights = winState.numWeights;
+    unsigned long long hits = 0ULL;
+    for (int sample = 0; sample < samples; ++sample)
+    {
+      unsigned long long chosen = 0ULL;
+      unsigned long long key = 0ULL;
+      for (int j = positionsOccupied - numWeights; j < positionsOccupied; ++j)
+      {
+        // Uniform slot in [0, j] from the high bits of the next value.
+        const unsigned long long r = detail::SplitMix64(seed) >> 32;
+        const unsigned long long range = static_cast<unsigned long long>(j + 1);
+        int slot = static_cast<int>((r * range) >> 32);
+        if (chosen & (1ULL << slot))
+        {
+          slot = j;
+        }
+        chosen |= (1ULL << slot);
+        key ^= slotKeys[slot];
+      }
+      hits += winState.Contains(BoardHashKey(key));
+    }
+    const unsigned long long numSamples =
+      static_cast<unsigned long long>(samples);
+    return static_cast<int>(((hits * cmbCount) + (numSamples / 2)) / numSamples);
+  }
+
+  /// <summary> Count the states of a layer among the subsets of a board. </summary>
+  static int CountSubsetStates(const NumWeightsWinStates& winState,
+                               const int positionsOccupied,
+                               const unsigned long long* slotKeys)
+  {
+    assert(slotKeys);
+    const unsigned int numWeights = winState.numWeights;
+    // See if any of the win states are reachable. Make combinations of
+    // the filled board positions. Each step swaps one member, so the key
+    // is updated with two XORs.
+    SlotRevolvingDoorIterator cmbIter(positionsOccupied, numWeights);
+    unsigned long long key = 0ULL;
+    for (unsigned int slot = 0; slot < numWeights; ++slot)
+    {
+      key ^= slotKeys[slot];
+    }
+    int count = winState.Contains(BoardHashKey(key));
+    while (cmbIter.Next())
+    {
+      key ^= slotKeys[cmbIter.GetOut()] ^ slotKeys[cmbIter.GetIn()];
+      // See if this board is a win state.
+      count += winState.Contains(BoardHashKey(key));
+    }
+    return count;
+  }
+
+  /// <summary> Count the states of a layer contained in a board. </summary>
+  static int CountContainedStates(const NumWeightsWinStates& winState,
+                                  const PackedBoard& board)
+  {
+    int count = 0;
+    for (const PackedSubBoard* state = winState.PackedBegin();
+         state != winState.PackedEnd();
+         ++state)
+    {
+      count += state->ContainedIn(board);
+    }
+    return count;
+  }
+
+  /// <summary> Collect the win states among the combinations of occupied
+  ///   positions visited by ParallelForCombinations().
+  /// </summary>
+  /// <remarks>
+  ///   <para> Sub-boards are tested in batches. Each worker's copy keeps the
+  ///     win states of its chunk and Join() appends them in chunk order.
+  ///   </para>
+  /// </remarks>
+  struct LayerCollector
+  {
+    LayerCollector(const Board& board_,
+                   const int positionsOccupied,
+                   const int* positions_,
+                   const unsigned long long* slotKeys_,
+                   const int numWeights_,
+                   const std::atomic<bool>* cancel_)
+      : board(&board_),
+        positions(positions_),
+        slotKeys(slotKeys_),
+        numWeights(numWeights_),
+        cancel(cancel_),
+        batch(numWeights_),
+        states(),
+        packedStates(),
+        keysValid(false)
+    {
+      assert(positions && slotKeys);
+      // Torque contributions of the weight in each slot.
+      for (int slot = 0; slot < positionsOccupied; ++slot)
+      {
+        const int pos = positions[slot];
+        detail::SubsetTorqueBatch::Contributions(pos, board_[pos],
+                                                 slotTorqueL + slot,
+                                                 slotTorqueR + slot);
+      }
+      prefixKeys[0] = 0ULL;
+    }
+
+    inline bool operator()(const SlotCombinationIterator& cmbIter,
+                           const unsigned long long)
+    {
+      // The first combination of a chunk is folded from scratch.
+      const unsigned int changeIdx = keysValid ? cmbIter.GetFirstChanged() : 0;
+      keysValid = true;
+      const unsigned long long cmbKey =
+        CombinationKey(cmbIter.GetCombination(), numWeights, changeIdx,
+                       slotKeys, prefixKeys);
+      batch.Add(cmbIter.GetCombination(), slotTorqueL, slotTorqueR, cmbKey);
+      if (batch.Full())
+      {
+        Flush();
+        return !(cancel && cancel->load(std::memory_order_relaxed));
+      }
+      return true;
+    }
+
+    void Finish()
+    {
+      Flush();
+    }
+
+    void Join(const LayerCollector& worker)
+    {
+      states.insert(states.end(), worker.states.begin(), worker.states.end());
+      packedStates.insert(packedStates.end(),
+                          worker.packedStates.begin(),
+                          worker.packedStates.end());
+    }
+
+    void Flush()
+    {
+      CollectBatchWinStates(*board, positions, batch, &states, &packedStates);
+      batch.Clear();
+    }
+
+    const Board* board;
+    const int* positions;
+    const unsigned long long* slotKeys;
+    unsigned int numWeights;
+    const std::atomic<bool>* cancel;
+    int slotTorqueL[Board::Positions];
+    int slotTorqueR[Board::Positions];
+    unsigned long long prefixKeys[Board::Positions + 1];
+    detail::SubsetTorqueBatch batch;
+    BoardHashList states;
+    std::vector<PackedSubBoard> packedStates;
+    /// <summary> Whether prefixKeys hold the previous combination. </summary>
+    bool keysValid;
+  };
+
+  /// <summary> Keep the win states of a batch of sub-boards. </summary>
+  static void CollectBatchWinStates(const Board& currentBoard,
+                                    const int* positions,
+                                    const detail::SubsetTorqueBatch& batch,
+                                    BoardHashList* states,
+                                    std::vector<PackedSubBoard>* packedStates)
+  {
+    assert(positions && states && packedStates);
+    unsigned long long winLanes = batch.WinStateLanes();
+    for (int lane = 0; 0ULL != winLanes; ++lane, winLanes >>= 1)
+    {
+      if (0ULL == (winLanes & 1ULL))
+      {
+        continue;
+      }
+      PackedBoard packedBoard;
+      for (int member = 0; member < batch.numMembers; ++member)
+      {
+        const int slot = batch.memberSlots[(member *
+                                            detail::SubsetTorqueBatch::Lanes) +
+                                           lane];
+        const int pos = positions[slot];
+        packedBoard.Set(pos, currentBoard[pos]);
+      }
+      states->push_back(BoardHashKey(batch.keys[lane]));
+      packedStates->push_back(PackedSubBoard(packedBoard));
+    }
+  }
+
+  /// <summary> Build the layer of win states with numWeights weights among
+  ///   the sub-boards of a board.
+  /// </summary>
+  /// <returns> False when cancelled before the layer was complete. </returns>
+  static bool GenerateLayer(const Board& board,
+                            const int numWeights,
+                            NumWeightsWinStates* layer,
+                            const std::atomic<bool>* cancel)
+  {
+    assert(layer);
+    *layer = NumWeightsWinStates();
+    layer->numWeights = numWeights;
+
+    // Enumerate all possible combinations of weights at depth.
+    int positionsOccupied;
+    int positions[Board::Positions];
+    CollectOccupiedPositions(board, &positionsOccupied, positions);
+    unsigned long long slotKeys[Board::Positions];
+    CollectOccupiedKeys(board, positionsOccupied, positions, slotKeys);
+    if (positionsOccupied < numWeights)
+    {
+      return true;
+    }
+    // Each worker takes an equal share of the lexicographic order.
+    LayerCollector collector(board, positionsOccupied, positions, slotKeys,
+                             numWeights, cancel);
+    ParallelForCombinations<Board::Positions>(positionsOccupied, numWeights,
+                                              0, &collector);
+    if (cancel && cancel->load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+    BoardHashList& states = layer->states;
+    states.swap(collector.states);
+    layer->packedStates.swap(collector.packedStates);
+    if (!states.empty())
+    {
+      layer->Finalize();
+      layer->BuildTouchingIndex();
+    }
+    return true;
+  }
+
+  /// <summary> Request win states from the current state. </summary>
+  /// <remarks>
+  ///   <para> The layers are built here with every OpenMP thread, before a
+  ///     search scores any board. When backgroundLayers is set they are
+  ///     built on a background thread instead, and scoring uses the layers
+  ///     that are ready and never waits.
+  ///   </para>
+  /// </remarks>
+  void Update(const State& state,
+              const int invDepthBegin,
+              const int invDepthEnd)
+  {
+    assert(invDepthBegin < invDepthEnd);
+    const Board& currentBoard = state.board;
+    // Layers in progress may be replaced, so finish with them first.
+    StopBackgroundLayers();
+    AdoptBuiltLayers();
+    // Scores cached against the old win states are stale.
+    ++cacheGeneration;
+
+    const int positionsOccupied = CountOccupied(currentBoard);
+    for (int invDepth = invDepthBegin;
+         (invDepth != invDepthEnd) && (positionsOccupied >= invDepth);
+         ++invDepth)
+    {
+      // Blue wins at odd depths and red at even.
+      WinStateList* winStates;
+      int* winStateCount;
+      if (invDepth & 1)
+      {
+        winStates = &blueWinStates;
+        winStateCount = &totalBlueWinStates;
+      }
+      else
+      {
+        winStates = &redWinStates;
+        winStateCount = &totalRedWinStates;
+      }
+      // See if we have computed for this depth.
+      for (WinStateList::iterator chkDepth = winStates->begin();
+           chkDepth != winStates->end();
+           ++chkDepth)
+      {
+        if (chkDepth->numWeights == invDepth)
+        {
+          *winStateCount -= static_cast<int>(chkDepth->Size());
+          winStates->erase(chkDepth);
+          break;
+        }
+      }
+      RequestedLayer& requested = requestedLayerList[invDepth];
+      requested.source = currentBoard;
+      requested.layer = NumWeightsWinStates();
+      requestedLayers |= LayerBit(invDepth);
+    }
+    if (0ULL == requestedLayers)
+    {
+      return;
+    }
+    if (backgroundLayers)
+    {
+      backgroundThread.Start(&BoardEvaluationReachableWinStates::BackgroundEntry,
+                             this);
+    }
+    else
+    {
+      WaitForLayers();
+    }
+  }
+
+  /// <summary> Choose how every layer searches its keys. </summary>
+  void SetKeySearch(const KeySearch keySearch_)
+  {
+    StopBackgroundLayers();
+    keySearch = keySearch_;
+    WinStateList* lists[] = { &redWinStates, &blueWinStates };
+    for (int listIdx = 0; listIdx < 2; ++listIdx)
+    {
+      for (WinStateList::iterator winState = lists[listIdx]->begin();
+           winState != lists[listIdx]->end();
+           ++winState)
+      {
+        winState->SetKeySearch(keySearch);
+      }
+    }
+    for (int numWeights = 1; numWeights <= MaxLayerWeights; ++numWeights)
+    {
+      if (builtLayers & LayerBit(numWeights))
+      {
+        requestedLayerList[numWeights].layer.SetKeySearch(keySearch);
+      }
+    }
+    if (backgroundLayers && (0ULL != (requestedLayers & ~builtLayers)))
+    {
+      backgroundThread.Start(&BoardEvaluationReachableWinStates::BackgroundEntry,
+                             this);
+    }
+  }
+
+  /// <summary> Build every requested layer and add it to the win states. </summary>
+  void WaitForLayers()
+  {
+    backgroundThread.Join();
+    for (int numWeights = 1; numWeights <= MaxLayerWeights; ++numWeights)
+    {
+      const unsigned long long layerBit = LayerBit(numWeights);
+      if ((requestedLayers & layerBit) && !(builtLayers & layerBit))
+      {
+        BuildRequestedLayer(numWeights, NULL);
+      }
+    }
+    AdoptBuiltLayers();
+  }
+
+  static inline unsigned long long LayerBit(const int numWeights)
+  {
+    assert((numWeights > 0) && (numWeights <= MaxLayerWeights));
+    return 1ULL << numWeights;
+  }
+
+  static inline int CountOccupied(const Board& board)
+  {
+    int occupied = 0;
+    for (Board::const_iterator w = board.begin(); w != board.end(); ++w)
+    {
+      occupied += (Board::Empty != *w);
+    }
+    return occupied;
+  }
+
+  /// <summary> Build a requested layer and publish it to scoring threads. </summary>
+  /// <remarks>
+  ///   <para> Only one thread builds at a time: either the background thread
+  ///     or the caller of WaitForLayers() once that thread has joined.
+  ///   </para>
+  /// </remarks>
+  bool BuildRequestedLayer(const int numWeights,
+                           const std::atomic<bool>* cancel)
+  {
+    RequestedLayer& requested = requestedLayerList[numWeights];
+    if (!GenerateLayer(requested.source, numWeights, &requested.layer, cancel))
+    {
+      return false;
+    }
+    requested.layer.SetKeySearch(keySearch);
+    // Publish the layer before invalidating scores made without it. A
+    // snapshot that sees the new generation also sees the layer.
+    builtLayers.fetch_or(LayerBit(numWeights), std::memory_order_release);
+    cacheGeneration.fetch_add(1U, std::memory_order_release);
+    return true;
+  }
+
+  /// <summary> Move built layers into the lists of win states. </summary>
+  void AdoptBuiltLayers()
+  {
+    assert(!backgroundThread.IsStarted());
+    for (int numWeights = 1; numWeights <= MaxLayerWeights; ++numWeights)
+    {
+      if (!(builtLayers & LayerBit(numWeights)))
+      {
+        continue;
+      }
+      NumWeightsWinStates& layer = requestedLayerList[numWeights].layer;
+      if (layer.Size() > 0)
+      {
+        WinStateList* winStates;
+        int* winStateCount;
+        if (numWeights & 1)
+        {
+          winStates = &blueWinStates;
+          winStateCount = &totalBlueWinStates;
+        }
+        else
+        {
+          winStates = &redWinStates;
+          winStateCount = &totalRedWinStates;
+        }
+        winStates->push_back(NumWeightsWinStates());
+        winStates->back().Swap(layer);
+        *winStateCount += static_cast<int>(winStates->back().Size());
+      }
+      layer = NumWeightsWinStates();
+    }
+    requestedLayers &= ~builtLayers;
+    builtLayers = 0ULL;
+  }
+
+  /// <summary> Cancel and wait for the background thread. </summary>
+  void StopBackgroundLayers()
+  {
+    if (backgroundThread.IsStarted())
+    {
+      cancelBackground.store(true, std::memory_order_relaxed);
+      backgroundThread.Join();
+      cancelBackground.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  static void BackgroundEntry(void* self)
+  {
+    static_cast<BoardEvaluationReachableWinStates*>(self)->BuildLayersInBackground();
+  }
+
+  /// <summary> Build the requested layers from the smallest up. </summary>
+  void BuildLayersInBackground()
+  {
+    for (int numWeights = 1;
+         (numWeights <= MaxLayerWeights) &&
+         !cancelBackground.load(std::memory_order_relaxed);
+         ++numWeights)
+    {
+      const unsigned long long layerBit = LayerBit(numWeights);
+      if ((requestedLayers & layerBit) && !(builtLayers & layerBit))
+      {
+        BuildRequestedLayer(numWeights, &cancelBackground);
+      }
+    }
+  }
+
+  /// <summary> Gather the layers that are ready for scoring. </summary>
+  void TakeSnapshot(LayerSnapshot* snapshot) const
+  {
+    assert(snapshot);
+    snapshot->generation = cacheGeneration.load(std::memory_order_acquire);
+    snapshot->built = builtLayers.load(std::memory_order_acquire);
+    snapshot->numRed = 0;
+    snapshot->numBlue = 0;
+    for (WinStateList::const_iterator winState = redWinStates.begin();
+         winState != redWinStates.end();
+         ++winState)
+    {
+      snapshot->red[snapshot->numRed++] = &*winState;
+    }
+    for (WinStateList::const_iterator winState = blueWinStates.begin();
+         winState != blueWinStates.end();
+         ++winState)
+    {
+      snapshot->blue[snapshot->numBlue++] = &*winState;
+    }
+    unsigned long long built = snapshot->built >> 1;
+    for (int numWeights = 1; 0ULL != built; ++numWeights, built >>= 1)
+    {
+      const NumWeightsWinStates& layer = requestedLayerList[numWeights].layer;
+      if ((built & 1ULL) && (layer.Size() > 0))
+      {
+        if (numWeights & 1)
+        {
+          snapshot->blue[snapshot->numBlue++] = &layer;
+        }
+        else
+        {
+          snapshot->red[snapshot->numRed++] = &layer;
+        }
+      }
+    }
+    assert(snapshot->numRed <= LayerSnapshot::MaxLayers);
+    assert(snapshot->numBlue <= LayerSnapshot::MaxLayers);
+  }
+
+  /// <summary> Score a board. </summary>
+  /// <remarks>
+  ///   <para> The score depends only on the board, so it is looked up in the
+  ///     calling thread's cache before counting win states.
+  ///   </para>
+  /// </remarks>
+  int operator()(const State& state) const
+  {
+    assert(!Tipped(state.board));
+
+    const unsigned long long boardKey = HashBoard(state.board);
+    const size_t threadIdx = static_cast<size_t>(omp_get_thread_num());
+    if (threadIdx >= evalCaches.size())
+    {
+      return Score(state.board);
+    }
+    EvalCache& cache = evalCaches[threadIdx];
+    EvalCache::Entry* entry = cache.Lookup(boardKey);
+    const unsigned int generation =
+      cacheGeneration.load(std::memory_order_acquire);
+    if ((entry->key == boardKey) && (entry->generation == generation))
+    {
+      ++cache.hits;
+      return entry->score;
+    }
+    ++cache.misses;
+    LayerSnapshot snapshot;
+    TakeSnapshot(&snapshot);
+    int score;
+    if (EvalMode_Incremental == evalMode)
+    {
+      score = ScoreIncremental(state.board, snapshot,
+                               &incrementalCounts[threadIdx]);
+    }
+    else if (EvalMode_Sampled == evalMode)
+    {
+      score = ScoreSampled(state.board, snapshot);
+    }
+    else
+    {
+      score = Score(state.board, snapshot);
+    }
+    entry->key = boardKey;
+    entry->generation = snapshot.generation;
+    entry->score = score;
+    return score;
+  }
+
+  /// <summary> Score a board by counting reachable win states. </summary>
+  int Score(const Board& board) const
+  {
+    LayerSnapshot snapshot;
+    TakeSnapshot(&snapshot);
+    return Score(board, snapshot);
+  }
+
+  /// <summary> Score a board by counting win states among some layers. </summary>
+  int Score(const Board& board, const LayerSnapshot& snapshot) const
+  {
+    // Count win states reachable.
+    const int redWinStatesReachable = WinStatesReachable(board,
+                                                         snapshot.red,
+                                                         snapshot.numRed);
+    const int blueWinStatesReachable = WinStatesReachable(board,
+                                                          snapshot.blue,
+                                                          snapshot.numBlue);
+    return ScoreCounts(redWinStatesReachable, blueWinStatesReachable);
+  }
+
+  /// <summary> Score a board from estimated counts of reachable win states. </summary>
+  int ScoreSampled(const Board& board, const LayerSnapshot& snapshot) const
+  {
+    const int redWinStatesReachable =
+      WinStatesReachableSampled(board, snapshot.red, snapshot.numRed,
+                                samplesPerLayer);
+    const int blueWinStatesReachable =
+      WinStatesReachableSampled(board, snapshot.blue, snapshot.numBlue,
+                                samplesPerLayer);
+    return ScoreCounts(redWinStatesReachable, blueWinStatesReachable);
+  }
+
+  /// <summary> Count win states touching a weight that are on the board. </summary>
+  static int CountTouching(const NumWeightsWinStates* const* layers,
+                           const int numLayers,
+                           const int pos,
+                           const Weight w,
+                           const PackedBoard& board)
+  {
+    int count = 0;
+    for (int layerIdx = 0; layerIdx < numLayers; ++layerIdx)
+    {
+      count += layers[layerIdx]->CountTouching(pos, w, board);
+    }
+    return count;
+  }
+
+  /// <summary> Score a board from the counts of the board last scored. </summary>
+  int ScoreIncremental(const Board& board, IncrementalCounts* counts) const
+  {
+    LayerSnapshot snapshot;
+    TakeSnapshot(&snapshot);
+    return ScoreIncremental(board, snapshot, counts);
+  }
+
+  /// <summary> Score a board from the counts of the board last scored. </summary>
+  /// <remarks>
+  ///   <para> Each changed position is applied as a removal of the old
+  ///     weight followed by an addition of the new one. A removal drops the
+  ///     win states touching the old weight that were on the board, and an
+  ///     addition picks up those touching the new weight that now are. The
+  ///     counts restart from the empty board when the win states change.
+  ///   </para>
+  /// </remarks>
+  int ScoreIncremental(const Board& board,
+                       const LayerSnapshot& snapshot,
+                       IncrementalCounts* counts) const
+  {
+    assert(counts);
+    if ((counts->generation != snapshot.generation) ||
+        (counts->layers != snapshot.built))
+    {
+      *counts = IncrementalCounts();
+      counts->generation = snapshot.generation;
+      counts->layers = snapshot.built;
+    }
+    const PackedBoard target(board);
+    PackedBoard& tracked = counts->board;
+    for (int word = 0; word < PackedBoard::Words; ++word)
+    {
+      unsigned long long diff = tracked.words[word] ^ target.words[word];
+      int idx = word * PackedBoard::PositionsPerWord;
+      for (; 0ULL != diff; diff >>= PackedBoard::BitsPerPosition, ++idx)
+      {
+        if (0ULL == (diff & PackedBoard::PositionMask))
+        {
+          continue;
+        }
+        const int pos = idx - Board::Size;
+        const Weight oldW = tracked.Get(pos);
+        if (Board::Empty != oldW)
+        {
+          counts->red -= CountTouching(snapshot.red, snapshot.numRed,
+                                       pos, oldW, tracked);
+          counts->blue -= CountTouching(snapshot.blue, snapshot.numBlue,
+                                        pos, oldW, tracked);
+          tracked.Set(pos, Board::Empty);
+        }
+        const Weight newW = target.Get(pos);
+        if (Board::Empty != newW)
+        {
+          tracked.Set(pos, newW);
+          counts->red += CountTouching(snapshot.red, snapshot.numRed,
+                                       pos, newW, tracked);
+          counts->blue += CountTouching(snapshot.blue, snapshot.numBlue,
+                                        pos, newW, tracked);
+        }
+      }
+    }
+    assert(counts->red >= 0);
+    assert(counts->blue >= 0);
+    return ScoreCounts(counts->red, counts->blue);
+  }
+
+  /// <summary> Score from the counts of reachable win states. </summary>
+  int ScoreCounts(const int redWinStatesReachable,
+                  const int blueWinStatesReachable) const
+  {
+    // If we have no information about win states...
+    const bool blind = (redWinStatesReachable + blueWinStatesReachable) > 0;
+    int score;
+    // I am red?
+    if (State::Turn_Red == who)
+    {
+      score = redWinStatesReachable - blueWinStatesReachable;
+      if (blind)
+      {
+        score = -blueWinStatesReachable;
+      }
+    }
+    // I am blue.
+    else
+    {
+      score = blueWinStatesReachable - redWinStatesReachable;
+      if (blind)
+      {
+        score = -redWinStatesReachable;
+      }
+    }
+    return score;
+  }
+
+  /// <summary> The player for whom we evaluate the board state. </sumamry>
+  State::Turn who;
+  /// <summary> List of red win states. </summary>
+  WinStateList redWinStates;
+  int totalRedWinStates;
+  /// <summary> List of blue win states. </summary>
+  WinStateList blueWinStates;
+  int totalBlueWinStates;
+  /// <summary> How boards missing from the cache are scored. </summary>
+  EvalMode evalMode;
+  /// <summary> Most tests per layer when evalMode is EvalMode_Sampled. </summary>
+  int samplesPerLayer;
+  /// <summary> How layers search their keys. Set with SetKeySearch(). </summary>
+  KeySearch keySearch;
+  /// <summary> Generation of the win states for cache validation. </summary>
+  std::atomic<unsigned int> cacheGeneration;
+  /// <summary> Score caches indexed by OpenMP thread number. </summary>
+  mutable std::vector<EvalCache> evalCaches;
+  /// <summary> Incremental counts indexed by OpenMP thread number. </summary>
+  mutable std::vector<IncrementalCounts> incrementalCounts;
+  /// <summary> Build requested layers on a background thread. </summary>
+  bool backgroundLayers;
+  /// <summary> Mask of the layers requested by Update(). </summary>
+  unsigned long long requestedLayers;
+  /// <summary> Mask of the requested layers that are ready. Set with
+  ///   release order once a layer is complete.
+  /// </summary>
+  std::atomic<unsigned long long> builtLayers;
+  /// <summary> Requested layers indexed by number of weights. </summary>
+  RequestedLayer requestedLayerList[MaxLayerWeights + 1];
+  std::atomic<bool> cancelBackground;
+  util::Thread backgroundThread;
 };
 
 }
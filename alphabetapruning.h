@@ -1,6 +1,7 @@
 #ifndef _NO_TIPPING_GAME_ALPHABETAPRUNING_H_
 #define _NO_TIPPING_GAME_ALPHABETAPRUNING_H_
 #include "ntg.h"
+#include "timer.h"
 #include <omp.h>
 
 namespace hps
@@ -19,8 +20,12 @@ struct AlphaBetaPruning
         maxDepth(-1),
         bestMinimax(0),
         bestPlyIdx(-1),
+        nodes(0ULL),
         dfsPlys(State::NumRemoved + (2 * Player::NumWeights) - 2),
-        victoryIsMine(NULL)
+        victoryIsMine(NULL),
+        timer(NULL),
+        maxTime(0.0),
+        aborted(NULL)
     {}
 
     State state;
@@ -28,8 +33,13 @@ struct AlphaBetaPruning
     int maxDepth;
     int bestMinimax;
     int bestPlyIdx;
+    /// <summary> States visited by this thread. </summary>
+    unsigned long long nodes;
     std::vector<std::vector<Ply> > dfsPlys;
     volatile bool* victoryIsMine;
+    const Timer* timer;
+    double maxTime;
+    volatile bool* aborted;
   };
 
   /// <summary> The parallel minimax parameters. </summary>
@@ -38,18 +48,33 @@ struct AlphaBetaPruning
     Params()
       : maxDepthAdding(3),
         maxDepthRemoving(8),
+        maxTime(0.0),
         depth(0),
+        nodes(0ULL),
+        aborted(false),
         rootPlys(),
         threadData()
     {}
 
     int maxDepthAdding;
     int maxDepthRemoving;
+    /// <summary> Seconds after which the run is aborted, none when not
+    ///   positive.
+    /// </summary>
+    double maxTime;
     int depth;
+    /// <summary> States visited by the last run. </summary>
+    unsigned long long nodes;
+    /// <summary> Set when the last run ran out of time. Its ply is then only
+    ///   the best of a partial search.
+    /// </summary>
+    volatile bool aborted;
     std::vector<Ply> rootPlys;
     std::vector<ThreadParams> threadData;
   };
 
+  enum { NodesPerTimeCheck = 1024, };
+
   /// <summary> Run alpha-beta pruning to get the ply for the state. </summary>
   template <typename BoardEvaulationFunction>
   static int Run(Params* params,
@@ -75,6 +100,9 @@ struct AlphaBetaPruning
 //    std::cout << "AlphaBetaPruning::Run() : maxDepth = " << maxDepth
 //              << "." << std::endl;
     ++depth;
+    params->nodes = 1ULL;
+    params->aborted = false;
+    const Timer timer;
 
     // Get the children of the current state.
     std::vector<Ply>& plys = params->rootPlys;
@@ -93,7 +121,9 @@ struct AlphaBetaPruning
       // Setup threads.
       std::vector<ThreadParams>& threadData = params->threadData;
       {
-        const int numProcs = omp_get_num_procs();
+        // Every thread of the parallel loop needs its own data.
+        const int numProcs = std::max(omp_get_num_procs(),
+                                      omp_get_max_threads());
         threadData.resize(numProcs);
         int initMinimax = std::numeric_limits<int>::min();
         for (int threadIdx = 0; threadIdx < numProcs; ++threadIdx)
@@ -102,10 +132,14 @@ struct AlphaBetaPruning
           {
             threadParams.bestMinimax = initMinimax;
             threadParams.bestPlyIdx = -1;
+            threadParams.nodes = 0ULL;
             threadParams.depth = depth;
             threadParams.maxDepth = maxDepth;
             threadParams.state = *state;
             threadParams.victoryIsMine = &victoryIsMine;
+            threadParams.timer = &timer;
+            threadParams.maxTime = params->maxTime;
+            threadParams.aborted = &params->aborted;
           }
         }
       }
@@ -118,7 +152,7 @@ struct AlphaBetaPruning
       {
         const int threadIdx = omp_get_thread_num();
         ThreadParams& threadParams = threadData[threadIdx];
-        if (!victoryIsMine)
+        if (!victoryIsMine && !params->aborted)
         {
           // Apply the ply for this state.
           Ply& mkChildPly = plys[plyIdx];
@@ -148,6 +182,13 @@ struct AlphaBetaPruning
         int bestPlyIdx;
         GatherRunThreadResults<std::greater<int> >(threadData,
                                                    &minimax, &bestPlyIdx);
+        for (std::vector<ThreadParams>::const_iterator threadParams =
+               threadData.begin();
+             threadParams != threadData.end();
+             ++threadParams)
+        {
+          params->nodes += threadParams->nodes;
+        }
         // Set MINIMax ply.
         *ply = plys[bestPlyIdx];
       }
@@ -228,13 +269,19 @@ private:
   static void GatherRunThreadResults(const std::vector<ThreadParams>& data,
                                      int* minimax, int* bestPlyIdx)
   {
+    // Skip threads that did not get a ply.
     std::vector<ThreadParams>::const_iterator result = data.begin();
+    while ((result->bestPlyIdx < 0) && ((result + 1) < data.end()))
+    {
+      ++result;
+    }
     *minimax = result->bestMinimax;
     *bestPlyIdx = result->bestPlyIdx;
     MinimaxFunc minimaxFunc;
     for (; result < data.end(); ++result)
     {
-      if (minimaxFunc(result->bestMinimax, *minimax))
+      if ((result->bestPlyIdx >= 0) &&
+          minimaxFunc(result->bestMinimax, *minimax))
       {
         *minimax = result->bestMinimax;
         *bestPlyIdx = result->bestPlyIdx;
@@ -259,7 +306,7 @@ private:
     MinimaxFunc minimaxFunc;
     for (; testPly != endPly; ++testPly)
     {
-      if (*victoryIsMine)
+      if (*victoryIsMine || *params->aborted)
       {
         //std::cout << "Got victory signal." << std::endl;
         *minimax = 0;
@@ -293,6 +340,14 @@ private:
     assert(!Tipped(state->board));
     assert(depth < maxDepth);
     ++depth;
+    ++params->nodes;
+    // Stop every thread once the time is up.
+    if ((params->maxTime > 0.0) &&
+        (0ULL == (params->nodes % NodesPerTimeCheck)) &&
+        (params->timer->GetTime() >= params->maxTime))
+    {
+      *params->aborted = true;
+    }
 
     // Get the children of the current state.
     std::vector<Ply>& plys = params->dfsPlys[params->depth - 2];
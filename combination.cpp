@@ -5,54 +5,76 @@ namespace hps
 namespace math
 {
 
-unsigned long long Factorial(const unsigned int n)
+namespace detail
 {
-  // 21! > max unsigned long long.
-  enum { MaxFactorial = 20, };
-  static std::vector<unsigned long long> s_factorialCache(MaxFactorial, 0);
-  assert(n <= MaxFactorial);
-
-  if (n < 1)
-  {
-    return 1ULL;
+#define HPS_BINOMIAL(n, k) Binomial<n, k>::value
+#define HPS_BINOMIAL_ROW(n)                                                    \
+  {                                                                            \
+    HPS_BINOMIAL(n, 0), HPS_BINOMIAL(n, 1), HPS_BINOMIAL(n, 2),                \
+    HPS_BINOMIAL(n, 3), HPS_BINOMIAL(n, 4), HPS_BINOMIAL(n, 5),                \
+    HPS_BINOMIAL(n, 6), HPS_BINOMIAL(n, 7), HPS_BINOMIAL(n, 8),                \
+    HPS_BINOMIAL(n, 9), HPS_BINOMIAL(n, 10), HPS_BINOMIAL(n, 11),              \
+    HPS_BINOMIAL(n, 12), HPS_BINOMIAL(n, 13), HPS_BINOMIAL(n, 14),             \
+    HPS_BINOMIAL(n, 15), HPS_BINOMIAL(n, 16), HPS_BINOMIAL(n, 17),             \
+    HPS_BINOMIAL(n, 18), HPS_BINOMIAL(n, 19), HPS_BINOMIAL(n, 20),             \
+    HPS_BINOMIAL(n, 21), HPS_BINOMIAL(n, 22), HPS_BINOMIAL(n, 23),             \
+    HPS_BINOMIAL(n, 24), HPS_BINOMIAL(n, 25), HPS_BINOMIAL(n, 26),             \
+    HPS_BINOMIAL(n, 27), HPS_BINOMIAL(n, 28), HPS_BINOMIAL(n, 29),             \
+    HPS_BINOMIAL(n, 30), HPS_BINOMIAL(n, 31), HPS_BINOMIAL(n, 32),             \
+    HPS_BINOMIAL(n, 33), HPS_BINOMIAL(n, 34), HPS_BINOMIAL(n, 35),             \
+    HPS_BINOMIAL(n, 36), HPS_BINOMIAL(n, 37), HPS_BINOMIAL(n, 38),             \
+    HPS_BINOMIAL(n, 39), HPS_BINOMIAL(n, 40), HPS_BINOMIAL(n, 41),             \
+    HPS_BINOMIAL(n, 42), HPS_BINOMIAL(n, 43), HPS_BINOMIAL(n, 44),             \
+    HPS_BINOMIAL(n, 45), HPS_BINOMIAL(n, 46), HPS_BINOMIAL(n, 47),             \
+    HPS_BINOMIAL(n, 48), HPS_BINOMIAL(n, 49), HPS_BINOMIAL(n, 50),             \
+    HPS_BINOMIAL(n, 51), HPS_BINOMIAL(n, 52), HPS_BINOMIAL(n, 53),             \
+    HPS_BINOMIAL(n, 54), HPS_BINOMIAL(n, 55), HPS_BINOMIAL(n, 56),             \
+    HPS_BINOMIAL(n, 57), HPS_BINOMIAL(n, 58), HPS_BINOMIAL(n, 59),             \
+    HPS_BINOMIAL(n, 60), HPS_BINOMIAL(n, 61), HPS_BINOMIAL(n, 62),             \
+    HPS_BINOMIAL(n, 63), HPS_BINOMIAL(n, 64)                                   \
   }
-  else
-  {
-    unsigned long long& nFactorial = s_factorialCache[n - 1];
-    if (0 != nFactorial)
-    {
-      return nFactorial;
-    }
-    else
-    {
-      nFactorial = n * Factorial(n - 1);
-      return nFactorial;
-    }
-  }
-}
-
-unsigned long long Choose(const unsigned int n, const unsigned int k)
+const unsigned long long s_binomials[MaxChooseN + 1][MaxChooseN + 1] =
 {
-  const bool zeroParam = (0 == (n * k));
-  const bool chooseMoreThanN = (k > n);
-  if (zeroParam || chooseMoreThanN)
-  {
-    return 0;
-  }
-  else if (n == k)
-  {
-    return 1;
-  }
+  HPS_BINOMIAL_ROW(0), HPS_BINOMIAL_ROW(1), HPS_BINOMIAL_ROW(2),
+  HPS_BINOMIAL_ROW(3), HPS_BINOMIAL_ROW(4), HPS_BINOMIAL_ROW(5),
+  HPS_BINOMIAL_ROW(6), HPS_BINOMIAL_ROW(7), HPS_BINOMIAL_ROW(8),
+  HPS_BINOMIAL_ROW(9), HPS_BINOMIAL_ROW(10), HPS_BINOMIAL_ROW(11),
+  HPS_BINOMIAL_ROW(12), HPS_BINOMIAL_ROW(13), HPS_BINOMIAL_ROW(14),
+  HPS_BINOMIAL_ROW(15), HPS_BINOMIAL_ROW(16), HPS_BINOMIAL_ROW(17),
+  HPS_BINOMIAL_ROW(18), HPS_BINOMIAL_ROW(19), HPS_BINOMIAL_ROW(20),
+  HPS_BINOMIAL_ROW(21), HPS_BINOMIAL_ROW(22), HPS_BINOMIAL_ROW(23),
+  HPS_BINOMIAL_ROW(24), HPS_BINOMIAL_ROW(25), HPS_BINOMIAL_ROW(26),
+  HPS_BINOMIAL_ROW(27), HPS_BINOMIAL_ROW(28), HPS_BINOMIAL_ROW(29),
+  HPS_BINOMIAL_ROW(30), HPS_BINOMIAL_ROW(31), HPS_BINOMIAL_ROW(32),
+  HPS_BINOMIAL_ROW(33), HPS_BINOMIAL_ROW(34), HPS_BINOMIAL_ROW(35),
+  HPS_BINOMIAL_ROW(36), HPS_BINOMIAL_ROW(37), HPS_BINOMIAL_ROW(38),
+  HPS_BINOMIAL_ROW(39), HPS_BINOMIAL_ROW(40), HPS_BINOMIAL_ROW(41),
+  HPS_BINOMIAL_ROW(42), HPS_BINOMIAL_ROW(43), HPS_BINOMIAL_ROW(44),
+  HPS_BINOMIAL_ROW(45), HPS_BINOMIAL_ROW(46), HPS_BINOMIAL_ROW(47),
+  HPS_BINOMIAL_ROW(48), HPS_BINOMIAL_ROW(49), HPS_BINOMIAL_ROW(50),
+  HPS_BINOMIAL_ROW(51), HPS_BINOMIAL_ROW(52), HPS_BINOMIAL_ROW(53),
+  HPS_BINOMIAL_ROW(54), HPS_BINOMIAL_ROW(55), HPS_BINOMIAL_ROW(56),
+  HPS_BINOMIAL_ROW(57), HPS_BINOMIAL_ROW(58), HPS_BINOMIAL_ROW(59),
+  HPS_BINOMIAL_ROW(60), HPS_BINOMIAL_ROW(61), HPS_BINOMIAL_ROW(62),
+  HPS_BINOMIAL_ROW(63), HPS_BINOMIAL_ROW(64)
+};
+#undef HPS_BINOMIAL_ROW
+#undef HPS_BINOMIAL
 
-  const unsigned int k_dual = (k > ((n + 1) / 2)) ? (n - k) : k;
-  unsigned long long delta = n - k_dual;
-  unsigned long long nCk = delta + 1;
-  for (unsigned int i = 2; i <= k_dual; ++i)
-  {
-    nCk *= (delta + i);
-    nCk /= i;
-  }
-  return nCk;
+const unsigned long long s_factorials[MaxFactorial + 1] =
+{
+  FactorialValue<0>::value, FactorialValue<1>::value,
+  FactorialValue<2>::value, FactorialValue<3>::value,
+  FactorialValue<4>::value, FactorialValue<5>::value,
+  FactorialValue<6>::value, FactorialValue<7>::value,
+  FactorialValue<8>::value, FactorialValue<9>::value,
+  FactorialValue<10>::value, FactorialValue<11>::value,
+  FactorialValue<12>::value, FactorialValue<13>::value,
+  FactorialValue<14>::value, FactorialValue<15>::value,
+  FactorialValue<16>::value, FactorialValue<17>::value,
+  FactorialValue<18>::value, FactorialValue<19>::value,
+  FactorialValue<20>::value
+};
 }
 
 void Combinadic(const unsigned int n, const unsigned int k,
@@ -60,6 +82,7 @@ void Combinadic(const unsigned int n, const unsigned int k,
                 Combination* const combinadic)
 {
   assert(combinadic);
+  assert(n <= detail::MaxChooseN);
   combinadic->resize(k);
 
   // Find numbers such that m = Choose(n_1, k) + ... + Chooes(n_k, 1)
@@ -70,40 +93,25 @@ void Combinadic(const unsigned int n, const unsigned int k,
   for (unsigned int cmbIdx = 0UL; cmbIdx < k; ++cmbIdx)
   {
     const unsigned int kSearch = k - cmbIdx;
-    unsigned long long largestV = Choose(--maxN, kSearch);
-    while (largestV > remain)
+    // Entries with n < kSearch are zero, so the search always stops.
+    do
     {
-      largestV = Choose(--maxN, kSearch);
-    }
-    remain -= largestV;
-    combinadic->at(cmbIdx) = static_cast<size_t>(maxN);
+      --maxN;
+    } while (detail::s_binomials[maxN][kSearch] > remain);
+    remain -= detail::s_binomials[maxN][kSearch];
+    (*combinadic)[cmbIdx] = static_cast<size_t>(maxN);
   }
   assert(0 == remain);
 }
 
 detail::CachedCombinadicGenerator::
 CachedCombinadicGenerator(const unsigned int n, const unsigned int k)
-: m_chooseCache(),
-  m_chooseCachePerK(0UL),
-  m_n(n),
+: m_n(n),
   m_k(k),
   m_nCk(0ULL)
 {
   assert(n >= k);
-  // Init cache storage with all nCk that we need to compute combinadic.
-  const size_t cacheSize = (n > (k + 2)) ? (n - k - 1) * k : 0;
-  if (cacheSize > 0)
-  {
-    m_chooseCachePerK = (n - k - 1);
-    m_chooseCache.reserve(cacheSize);
-    for (unsigned int kIncr = k; kIncr > 0; --kIncr)
-    {
-      for (unsigned int nIncr = kIncr + m_chooseCachePerK; nIncr > kIncr; --nIncr)
-      {
-        m_chooseCache.push_back(Choose(nIncr, kIncr));
-      }
-    }
-  }
+  assert(n <= MaxChooseN);
   // Store number of combinations.
   m_nCk = Choose(m_n, m_k);
 }
@@ -111,57 +119,8 @@ CachedCombinadicGenerator(const unsigned int n, const unsigned int k)
 void detail::CachedCombinadicGenerator::
 GetCombinadic(const unsigned long long m, Combination* const combinadic) const
 {
-  assert(combinadic);
-  combinadic->resize(m_k);
-
-  // Find numbers such that m = Choose(n_1, k) + ... + Chooes(n_k, 1)
-  const unsigned long long dual = m_nCk - static_cast<unsigned long long>(m + 1);
-  unsigned long long remain = dual;
-  unsigned int maxN = m_n - 1;
-  // Use cache to compute nCk values.
-  const std::vector<unsigned long long>& chooseCache = m_chooseCache;
-  const size_t cacheSize = m_chooseCache.size();
-  size_t cacheIdx = 0UL; 
-  size_t maxSearchIdx = m_chooseCachePerK;
-  for (unsigned int cmbIdx = 0UL; cmbIdx < m_k; ++cmbIdx, --maxN)
-  {
-    // Find the maxN such that Choose(maxN, k - n_cmbIdx) <= remain.
-    // Only search when maxSearchIdx is enabled (not reached trivial cases
-    //   nCn or (n-1)Cn).
-    size_t searchIdx;
-    bool foundValue = false;
-    for (searchIdx = 0;
-         (searchIdx < maxSearchIdx) && (cacheIdx < cacheSize);
-         ++searchIdx, ++cacheIdx, --maxN)
-    {
-      const unsigned long long& cacheVal = chooseCache.at(cacheIdx);
-      if (cacheVal <= remain)
-      {
-        foundValue = true;
-        remain -= cacheVal;
-        combinadic->at(cmbIdx) = maxN;
-        cacheIdx += m_chooseCachePerK;
-        break;
-      }
-    }
-    // Else need to check 1Ck or 0Ck cases.
-    if (!foundValue)
-    {
-      // Everything from now on is either 0 or one case.
-      maxSearchIdx = 0;
-      if (remain > 0)
-      {
-        // When we hit zero, the next round drops by one.
-        combinadic->at(cmbIdx) = GetK() - cmbIdx;
-        --remain;
-      }
-      else
-      {
-        combinadic->at(cmbIdx) = GetK() - cmbIdx - 1;
-      }
-    }
-  }
-  assert(0 == remain);
+  // The binomial table serves every family, so nothing is cached here.
+  Combinadic(m_n, m_k, m, combinadic);
 }
 
 RandomAccessLexicographicCombinations::
@@ -169,34 +128,5 @@ RandomAccessLexicographicCombinations(const unsigned int n, const unsigned int k
 : detail::CachedCombinadicGenerator(n, k)
 {}
 
-void FastCombinationIterator::
-Next(unsigned long long* const m, Combination* const combination)
-{
-  // Generate the next combination by traversing the wheels in reverse.
-  unsigned int kIdx = 0UL;
-  unsigned int nextWheelValue = 0UL;
-  Combination::reverse_iterator wheelRev = m_combination.rbegin();
-  Combination::iterator wheel = m_combination.end();
-  for (; kIdx < m_k; ++kIdx, ++wheelRev, --wheel)
-  {
-    nextWheelValue = *wheelRev + 1;
-    // Did we find the next iteration?
-    if (nextWheelValue < (m_n - kIdx))
-    {
-      --wheel;
-      break;
-    }
-  }
-  nextWheelValue %= (m_n - kIdx + 1); 
-  for (; wheel != m_combination.end(); ++wheel, ++nextWheelValue)
-  {
-    *wheel = nextWheelValue;
-  }
-  // Compute this m and return combination.
-  m_m = ++m_m % m_nCk;
-  *m = m_m;
-  *combination = m_combination;
-}
-
 }
 }
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <functional>
 #include <assert.h>
+#include <omp.h>
 
 namespace hps
 {
@@ -13,11 +14,78 @@ namespace math
 /// <summary> A combination is a list of indices. </summary>
 typedef std::vector<size_t> Combination;
 
-/// <summary> Compute n! using a cache to increase performance. </summary>
-unsigned long long Factorial(const unsigned int n);
+namespace detail
+{
+/// <summary> n choose k computed by the compiler from Pascal's rule. </summary>
+template <unsigned int N, unsigned int K>
+struct Binomial
+{
+  static const unsigned long long value = Binomial<N - 1, K - 1>::value +
+                                          Binomial<N - 1, K>::value;
+};
+template <unsigned int N>
+struct Binomial<N, 0>
+{
+  static const unsigned long long value = 1ULL;
+};
+template <unsigned int K>
+struct Binomial<0, K>
+{
+  static const unsigned long long value = 0ULL;
+};
+template <>
+struct Binomial<0, 0>
+{
+  static const unsigned long long value = 1ULL;
+};
+
+/// <summary> n! computed by the compiler. </summary>
+template <unsigned int N>
+struct FactorialValue
+{
+  static const unsigned long long value = N * FactorialValue<N - 1>::value;
+};
+template <>
+struct FactorialValue<0>
+{
+  static const unsigned long long value = 1ULL;
+};
+
+// 64 choose 32 is the largest entry and fits in 64 bits.
+enum { MaxChooseN = 64, };
+// 21! > max unsigned long long.
+enum { MaxFactorial = 20, };
+
+/// <summary> Pascal's triangle indexed by [n][k]. </summary>
+/// <remarks>
+///   <para> The table is a constant expression, so it is initialized before
+///     any code runs and may be read from any thread.
+///   </para>
+/// </remarks>
+extern const unsigned long long s_binomials[MaxChooseN + 1][MaxChooseN + 1];
+extern const unsigned long long s_factorials[MaxFactorial + 1];
+}
+
+/// <summary> Compute n!. </summary>
+inline unsigned long long Factorial(const unsigned int n)
+{
+  assert(n <= detail::MaxFactorial);
+  return detail::s_factorials[n];
+}
 
 /// <summary> Compute n choose k. </summary>
-unsigned long long Choose(const unsigned int n, const unsigned int k);
+/// <remarks>
+///   <para> Returns 0 when either n or k is zero or when k exceeds n. </para>
+/// </remarks>
+inline unsigned long long Choose(const unsigned int n, const unsigned int k)
+{
+  if ((0 == k) || (k > n))
+  {
+    return 0ULL;
+  }
+  assert(n <= detail::MaxChooseN);
+  return detail::s_binomials[n][k];
+}
 
 
 /// <summary> Compute the combinadic of a number. </summary>
@@ -71,9 +139,6 @@ public:
   }
 
 private:
-  /// <summary> Cache of nCk values to find the combinadic. </summary>
-  std::vector<unsigned long long> m_chooseCache;
-  size_t m_chooseCachePerK;
   unsigned int m_n;
   unsigned int m_k;
   unsigned long long m_nCk;
@@ -97,45 +162,525 @@ public:
   }
 };
 
-/// <summary> Iterate the family of combinations nCk in O(k) time per iteration. </summary>
-class FastCombinationIterator
+/// <summary> Iterate the family of combinations nCk without allocating. </summary>
+/// <remarks>
+///   <para> The combination is stored inline for k up to MaxK and is exposed
+///     by reference and as a bitmask of its members, so n may be at most 64.
+///     Each step costs amortized O(1) and reports the first member that
+///     changed so that callers may update what they derive from the
+///     members incrementally.
+///   </para>
+/// </remarks>
+template <unsigned int MaxK_>
+class FixedCombinationIterator
 {
 public:
-  FastCombinationIterator(const unsigned int n, const unsigned int k,
-                          const unsigned long long nextM)
+  enum { MaxK = MaxK_, };
+  enum { MaxN = 64, };
+
+  /// <summary> Start so that the first call to Next() gives combination
+  ///   nextM.
+  /// </summary>
+  FixedCombinationIterator(const unsigned int n, const unsigned int k,
+                           const unsigned long long nextM)
     : m_n(n),
       m_k(k),
       m_nCk(Choose(n, k)),
       m_m(0ULL),
-      m_combination(k)
+      m_mask(0ULL),
+      m_firstChanged(0)
   {
+    assert(k <= MaxK);
+    assert(n <= MaxN);
     assert(nextM < m_nCk);
-    if (0 == nextM)
+    m_m = (0 == nextM) ? (m_nCk - 1) : (nextM - 1);
+    Unrank(m_m);
+  }
+
+  /// <summary> Step to the next combination in lexicographic order. </summary>
+  /// <returns> The index of the new combination. </returns>
+  inline unsigned long long Next()
+  {
+    // Find the last member that can advance. When there is none the
+    // family wraps around to the first combination.
+    unsigned int kIdx = m_k;
+    while ((kIdx > 0) && (m_combination[kIdx - 1] == (m_n - m_k + kIdx - 1)))
     {
-      m_m = m_nCk - 1;
+      --kIdx;
     }
-    else
+    size_t value = 0;
+    if (kIdx > 0)
+    {
+      --kIdx;
+      value = m_combination[kIdx] + 1;
+    }
+    m_firstChanged = kIdx;
+    for (unsigned int clearIdx = kIdx; clearIdx < m_k; ++clearIdx)
+    {
+      m_mask &= ~(1ULL << m_combination[clearIdx]);
+    }
+    for (; kIdx < m_k; ++kIdx, ++value)
     {
-      m_m = nextM - 1;
+      m_combination[kIdx] = value;
+      m_mask |= (1ULL << value);
     }
-    LexicographicCombination(n, k, m_m, &m_combination);
+    m_m = (m_m + 1) % m_nCk;
+    return m_m;
   }
 
-  void Next(unsigned long long* const m, Combination* const combination);
-
+  inline const size_t& operator[](const unsigned int kIdx) const
+  {
+    assert(kIdx < m_k);
+    return m_combination[kIdx];
+  }
+  /// <summary> The k members in increasing order. </summary>
+  inline const size_t* GetCombination() const
+  {
+    return m_combination;
+  }
+  /// <summary> Bit i is set when i is a member. </summary>
+  inline unsigned long long GetMask() const
+  {
+    return m_mask;
+  }
+  /// <summary> Index of the first member changed by the last Next(). </summary>
+  inline unsigned int GetFirstChanged() const
+  {
+    return m_firstChanged;
+  }
+  inline unsigned int GetK() const
+  {
+    return m_k;
+  }
   inline unsigned long long GetCombinationCount() const
   {
     return m_nCk;
   }
 
 private:
+  /// <summary> Set the mth combination in lexicographic order. </summary>
+  void Unrank(unsigned long long m)
+  {
+    assert(m < m_nCk);
+    m_mask = 0ULL;
+    size_t value = 0;
+    for (unsigned int kIdx = 0; kIdx < m_k; ++kIdx, ++value)
+    {
+      // Skip the combinations that have a smaller member here.
+      const unsigned int kRemain = m_k - kIdx - 1;
+      for (;;)
+      {
+        const unsigned int nRemain = m_n - static_cast<unsigned int>(value) - 1;
+        const unsigned long long skipped = (0 == kRemain) ?
+                                           1ULL : Choose(nRemain, kRemain);
+        if (skipped > m)
+        {
+          break;
+        }
+        m -= skipped;
+        ++value;
+      }
+      m_combination[kIdx] = value;
+      m_mask |= (1ULL << value);
+    }
+    assert(0ULL == m);
+  }
+
   unsigned int m_n;
   unsigned int m_k;
   unsigned long long m_nCk;
   unsigned long long m_m;
-  Combination m_combination;
+  unsigned long long m_mask;
+  unsigned int m_firstChanged;
+  size_t m_combination[MaxK];
+};
+
+/// <summary> Iterate the family of combinations nCk in revolving door order. </summary>
+/// <remarks>
+///   <para> Each step swaps exactly one member out and one member in, which
+///     are reported by GetOut() and GetIn(), so sums and keys over the
+///     members may be updated in O(1) per combination. This is Algorithm R
+///     of Knuth, TAOCP 7.2.1.3. The order is not lexicographic.
+///   </para>
+///   <para> The iterator starts at the combination {0, ..., k - 1}. </para>
+/// </remarks>
+template <unsigned int MaxK_>
+class RevolvingDoorCombinationIterator
+{
+public:
+  enum { MaxK = MaxK_, };
+  enum { MaxN = 64, };
+
+  RevolvingDoorCombinationIterator(const unsigned int n, const unsigned int k)
+    : m_n(n),
+      m_k(k),
+      m_nCk(Choose(n, k)),
+      m_mask(0ULL),
+      m_out(0),
+      m_in(0)
+  {
+    assert(k > 0);
+    assert(k <= n);
+    assert(k <= MaxK);
+    assert(n <= MaxN);
+    Reset();
+  }
+
+  /// <summary> Return to the first combination. </summary>
+  void Reset()
+  {
+    // Members are c[1..k] in increasing order with c[k + 1] = n.
+    for (unsigned int j = 1; j <= m_k; ++j)
+    {
+      m_c[j] = j - 1;
+    }
+    m_c[m_k + 1] = m_n;
+    m_mask = (m_k < 64) ? ((1ULL << m_k) - 1ULL) : ~0ULL;
+    m_out = 0;
+    m_in = 0;
+  }
+
+  /// <summary> Step to the next combination. </summary>
+  /// <returns> False after the last combination. </returns>
+  inline bool Next()
+  {
+    size_t* c = m_c;
+    const unsigned int k = m_k;
+    // Algorithm R needs 1 < k < n.
+    if (1 == k)
+    {
+      if ((c[1] + 1) >= m_n)
+      {
+        return false;
+      }
+      Swap(c[1], c[1] + 1);
+      c[1] += 1;
+      return true;
+    }
+    if (k == m_n)
+    {
+      return false;
+    }
+    // Easy case: move the smallest member.
+    unsigned int j = 2;
+    bool increase;
+    if (k & 1)
+    {
+      if ((c[1] + 1) < c[2])
+      {
+        Swap(c[1], c[1] + 1);
+        c[1] += 1;
+        return true;
+      }
+      increase = false;
+    }
+    else
+    {
+      if (c[1] > 0)
+      {
+        Swap(c[1], c[1] - 1);
+        c[1] -= 1;
+        return true;
+      }
+      increase = true;
+    }
+    for (;;)
+    {
+      if (!increase)
+      {
+        // Try to decrease c[j], where c[j] = c[j - 1] + 1.
+        if (c[j] >= j)
+        {
+          Swap(c[j], j - 2);
+          c[j] = c[j - 1];
+          c[j - 1] = j - 2;
+          return true;
+        }
+        ++j;
+      }
+      // Try to increase c[j], where c[j - 1] = j - 2.
+      if (j > k)
+      {
+        return false;
+      }
+      if ((c[j] + 1) < c[j + 1])
+      {
+        Swap(j - 2, c[j] + 1);
+        c[j - 1] = c[j];
+        c[j] += 1;
+        return true;
+      }
+      ++j;
+      if (j > k)
+      {
+        return false;
+      }
+      increase = false;
+    }
+  }
+
+  /// <summary> The member removed by the last Next(). </summary>
+  inline size_t GetOut() const
+  {
+    return m_out;
+  }
+  /// <summary> The member added by the last Next(). </summary>
+  inline size_t GetIn() const
+  {
+    return m_in;
+  }
+  /// <summary> The k members in increasing order. </summary>
+  inline const size_t* GetCombination() const
+  {
+    return m_c + 1;
+  }
+  /// <summary> Bit i is set when i is a member. </summary>
+  inline unsigned long long GetMask() const
+  {
+    return m_mask;
+  }
+  inline unsigned int GetK() const
+  {
+    return m_k;
+  }
+  inline unsigned long long GetCombinationCount() const
+  {
+    return m_nCk;
+  }
+
+private:
+  inline void Swap(const size_t out, const size_t in)
+  {
+    m_out = out;
+    m_in = in;
+    m_mask ^= (1ULL << out) | (1ULL << in);
+  }
+
+  unsigned int m_n;
+  unsigned int m_k;
+  unsigned long long m_nCk;
+  unsigned long long m_mask;
+  size_t m_out;
+  size_t m_in;
+  size_t m_c[MaxK + 2];
+};
+
+/// <summary> Iterate the family of combinations nCk in O(k) time per iteration. </summary>
+/// <remarks>
+///   <para> Copies each combination into a Combination. Inner loops should
+///     use FixedCombinationIterator directly.
+///   </para>
+/// </remarks>
+class FastCombinationIterator
+{
+public:
+  /// <summary> Any k whose members fit the mask. </summary>
+  enum { MaxK = 64, };
+
+  FastCombinationIterator(const unsigned int n, const unsigned int k,
+                          const unsigned long long nextM)
+    : m_iter(n, k, nextM)
+  {}
+
+  inline void Next(unsigned long long* const m, Combination* const combination)
+  {
+    assert(m && combination);
+    *m = m_iter.Next();
+    const size_t* members = m_iter.GetCombination();
+    combination->assign(members, members + m_iter.GetK());
+  }
+
+  inline unsigned long long GetCombinationCount() const
+  {
+    return m_iter.GetCombinationCount();
+  }
+
+private:
+  FixedCombinationIterator<MaxK> m_iter;
+};
+
+namespace detail
+{
+/// <summary> Index of the highest set bit of a nonzero value. </summary>
+inline unsigned int HighestBit(const unsigned long long x)
+{
+  assert(0ULL != x);
+#if defined(__GNUC__)
+  return 63U - static_cast<unsigned int>(__builtin_clzll(x));
+#else
+  unsigned int bit = 0;
+  for (unsigned long long shifted = x >> 1; 0ULL != shifted; shifted >>= 1)
+  {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+}
+
+/// <summary> Generate the family nCk as member bitmasks in blocks. </summary>
+/// <remarks>
+///   <para> Masks come in lexicographic order of the member lists, the same
+///     order as FastCombinationIterator, with bit i set when i is a member.
+///     Each mask is derived from the previous one with a few bit operations
+///     and the generator stops after the last combination. A generator may
+///     be resumed from the last mask that an earlier one produced.
+///   </para>
+/// </remarks>
+class CombinationMaskGenerator
+{
+public:
+  enum { MaxN = 64, };
+
+  /// <summary> Start before the first combination. </summary>
+  CombinationMaskGenerator(const unsigned int n, const unsigned int k)
+    : m_n(n),
+      m_k(k),
+      m_mask(0ULL),
+      m_started(false),
+      m_done(0ULL == Choose(n, k))
+  {
+    assert(n <= MaxN);
+  }
+
+  /// <summary> Start after the combination lastMask. </summary>
+  CombinationMaskGenerator(const unsigned int n, const unsigned int k,
+                           const unsigned long long lastMask)
+    : m_n(n),
+      m_k(k),
+      m_mask(lastMask),
+      m_started(true),
+      m_done(0ULL == Choose(n, k))
+  {
+    assert(n <= MaxN);
+    assert((n == MaxN) || (0ULL == (lastMask >> n)));
+  }
+
+  /// <summary> Write up to count of the next masks. </summary>
+  /// <returns> The number written, less than count only at the end. </returns>
+  template <typename MaskType>
+  size_t NextMasks(MaskType* masks, const size_t count)
+  {
+    assert(masks);
+    assert(m_n <= (8 * sizeof(MaskType)));
+    size_t written = 0;
+    if (!m_started && !m_done && (count > 0))
+    {
+      m_mask = (m_k < 64) ? ((1ULL << m_k) - 1ULL) : ~0ULL;
+      m_started = true;
+      masks[written++] = static_cast<MaskType>(m_mask);
+    }
+    for (; (written < count) && Advance(); ++written)
+    {
+      masks[written] = static_cast<MaskType>(m_mask);
+    }
+    return written;
+  }
+
+  /// <summary> The last mask written, to resume from. </summary>
+  inline unsigned long long GetLastMask() const
+  {
+    return m_mask;
+  }
+  inline bool IsDone() const
+  {
+    return m_done;
+  }
+
+private:
+  /// <summary> Step to the lexicographic successor of m_mask. </summary>
+  inline bool Advance()
+  {
+    if (m_done)
+    {
+      return false;
+    }
+    // Members packed against the top of [0, n) cannot advance. The member
+    // below them moves up one and they follow it.
+    const unsigned long long full = (m_n < 64) ? ((1ULL << m_n) - 1ULL) :
+                                                 ~0ULL;
+    const unsigned long long vacant = ~m_mask & full;
+    if (0ULL == vacant)
+    {
+      m_done = true;
+      return false;
+    }
+    const unsigned int topVacant = detail::HighestBit(vacant);
+    const unsigned int packed = m_n - 1 - topVacant;
+    const unsigned long long below = m_mask & ((1ULL << topVacant) - 1ULL);
+    if (0ULL == below)
+    {
+      m_done = true;
+      return false;
+    }
+    const unsigned int mover = detail::HighestBit(below);
+    m_mask = (below & ~(1ULL << mover)) |
+             (((1ULL << (packed + 1)) - 1ULL) << (mover + 1));
+    return true;
+  }
+
+  unsigned int m_n;
+  unsigned int m_k;
+  unsigned long long m_mask;
+  bool m_started;
+  bool m_done;
 };
 
+/// <summary> Visit every combination of nCk on several threads. </summary>
+/// <remarks>
+///   <para> The lexicographic order [0, nCk) is split into one contiguous,
+///     balanced chunk per worker and each worker starts its iterator at its
+///     chunk through the combinadic. Every worker gets its own copy of the
+///     body, which must provide:
+///   </para>
+///   <para> bool operator()(const FixedCombinationIterator&lt;MaxK&gt;&amp;,
+///     unsigned long long m) is called for combination m in order and
+///     returns false to stop the worker early.
+///   </para>
+///   <para> void Finish() is called by the worker after its chunk. </para>
+///   <para> void Join(Body&amp; worker) reduces a worker's body into *body.
+///     Workers are joined in chunk order on the calling thread, so results
+///     appended by Join() keep the lexicographic order.
+///   </para>
+///   <para> Pass threads &lt;= 0 to use omp_get_max_threads() workers. </para>
+/// </remarks>
+template <unsigned int MaxK, typename Body>
+void ParallelForCombinations(const unsigned int n, const unsigned int k,
+                             const int threads, Body* body)
+{
+  assert(body);
+  const unsigned long long nCk = Choose(n, k);
+  if (0ULL == nCk)
+  {
+    return;
+  }
+  const unsigned long long maxWorkers = (threads > 0) ?
+                                        threads : omp_get_max_threads();
+  const int numWorkers = static_cast<int>(std::min(nCk, maxWorkers));
+  std::vector<Body> workerBodies(numWorkers, *body);
+#pragma omp parallel for schedule(static, 1) num_threads(numWorkers)
+  for (int worker = 0; worker < numWorkers; ++worker)
+  {
+    const unsigned long long cmbBegin = (nCk * worker) / numWorkers;
+    const unsigned long long cmbEnd = (nCk * (worker + 1)) / numWorkers;
+    Body& workerBody = workerBodies[worker];
+    FixedCombinationIterator<MaxK> cmbIter(n, k, cmbBegin);
+    for (unsigned long long m = cmbBegin; m < cmbEnd; ++m)
+    {
+      cmbIter.Next();
+      if (!workerBody(cmbIter, m))
+      {
+        break;
+      }
+    }
+    workerBody.Finish();
+  }
+  for (int worker = 0; worker < numWorkers; ++worker)
+  {
+    body->Join(workerBodies[worker]);
+  }
+}
+
 }
 using namespace math;
 }
@@ -0,0 +1,307 @@
+#ifndef _MATH_COMBINATION_GTEST_H_
+#define _MATH_COMBINATION_GTEST_H_
+#include "combination.h"
+#include "gtest/gtest.h"
+
+namespace _math_combination_gtest_h_
+{
+using namespace hps;
+
+TEST(Combination, RevolvingDoorCombinationIterator)
+{
+  enum { MaxK = 7, };
+  for (unsigned int n = 1; n <= 12; ++n)
+  {
+    for (unsigned int k = 1; k <= std::min(n, 7U); ++k)
+    {
+      RevolvingDoorCombinationIterator<MaxK> cmbIter(n, k);
+      std::vector<unsigned long long> masks;
+      unsigned long long prevMask = 0ULL;
+      do
+      {
+        const unsigned long long mask = cmbIter.GetMask();
+        // Members are sorted and agree with the mask.
+        unsigned long long memberMask = 0ULL;
+        for (unsigned int member = 0; member < k; ++member)
+        {
+          const size_t value = cmbIter.GetCombination()[member];
+          ASSERT_LT(value, static_cast<size_t>(n));
+          if (member > 0)
+          {
+            EXPECT_LT(cmbIter.GetCombination()[member - 1], value);
+          }
+          memberMask |= (1ULL << value);
+        }
+        EXPECT_EQ(memberMask, mask);
+        // One member out and one in.
+        if (!masks.empty())
+        {
+          EXPECT_EQ((1ULL << cmbIter.GetOut()) | (1ULL << cmbIter.GetIn()),
+                    prevMask ^ mask);
+          EXPECT_TRUE(0ULL != (prevMask & (1ULL << cmbIter.GetOut())));
+          EXPECT_TRUE(0ULL != (mask & (1ULL << cmbIter.GetIn())));
+        }
+        masks.push_back(mask);
+        prevMask = mask;
+      } while (cmbIter.Next());
+      // Every combination exactly once.
+      ASSERT_EQ(Choose(n, k), masks.size());
+      std::sort(masks.begin(), masks.end());
+      EXPECT_TRUE(masks.end() == std::unique(masks.begin(), masks.end()));
+    }
+  }
+}
+
+TEST(Combination, CombinationMaskGenerator)
+{
+  enum { MaxK = 8, };
+  const size_t blockSizes[] = { 1, 7, 16, };
+  const unsigned int ns[] = { 1, 6, 13, 31, 64, };
+  for (size_t nIdx = 0; nIdx < (sizeof(ns) / sizeof(ns[0])); ++nIdx)
+  {
+    const unsigned int n = ns[nIdx];
+    for (unsigned int k = 1; k <= std::min(n, 8U); ++k)
+    {
+      const unsigned long long nCk = Choose(n, k);
+      if (nCk > 100000ULL)
+      {
+        continue;
+      }
+      // Same order as the iterator in any block size.
+      std::vector<unsigned long long> expected;
+      FixedCombinationIterator<MaxK> cmbIter(n, k, 0ULL);
+      for (unsigned long long m = 0; m < nCk; ++m)
+      {
+        cmbIter.Next();
+        expected.push_back(cmbIter.GetMask());
+      }
+      for (size_t blockIdx = 0;
+           blockIdx < (sizeof(blockSizes) / sizeof(blockSizes[0]));
+           ++blockIdx)
+      {
+        const size_t blockSize = blockSizes[blockIdx];
+        CombinationMaskGenerator gen(n, k);
+        std::vector<unsigned long long> masks;
+        std::vector<unsigned long long> block(blockSize);
+        for (;;)
+        {
+          const size_t written = gen.NextMasks(&block[0], blockSize);
+          masks.insert(masks.end(), block.begin(), block.begin() + written);
+          if (written < blockSize)
+          {
+            break;
+          }
+        }
+        EXPECT_TRUE(gen.IsDone());
+        ASSERT_EQ(expected.size(), masks.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(),
+                               masks.begin()));
+      }
+      // Resume from the middle with 32-bit masks.
+      if ((n <= 32) && (nCk > 1))
+      {
+        const size_t resumeIdx = static_cast<size_t>(nCk / 2);
+        CombinationMaskGenerator gen(n, k, expected[resumeIdx - 1]);
+        std::vector<unsigned int> masks(static_cast<size_t>(nCk));
+        const size_t written = gen.NextMasks(&masks[0], masks.size());
+        ASSERT_EQ(static_cast<size_t>(nCk) - resumeIdx, written);
+        for (size_t maskIdx = 0; maskIdx < written; ++maskIdx)
+        {
+          EXPECT_EQ(expected[resumeIdx + maskIdx], masks[maskIdx]);
+        }
+      }
+    }
+  }
+}
+
+/// <summary> Record the combinations visited by a worker. </summary>
+struct RecordCombinations
+{
+  enum { MaxK = 8, };
+
+  RecordCombinations() : stopAt(~0ULL), ms(), masks(), finished(0) {}
+
+  bool operator()(const FixedCombinationIterator<MaxK>& cmbIter,
+                  const unsigned long long m)
+  {
+    ms.push_back(m);
+    masks.push_back(cmbIter.GetMask());
+    return m != stopAt;
+  }
+  void Finish()
+  {
+    ++finished;
+  }
+  void Join(const RecordCombinations& worker)
+  {
+    ms.insert(ms.end(), worker.ms.begin(), worker.ms.end());
+    masks.insert(masks.end(), worker.masks.begin(), worker.masks.end());
+    finished += worker.finished;
+  }
+
+  unsigned long long stopAt;
+  std::vector<unsigned long long> ms;
+  std::vector<unsigned long long> masks;
+  int finished;
+};
+
+TEST(Combination, ParallelForCombinations)
+{
+  const unsigned int n = 13;
+  const unsigned int k = 5;
+  const unsigned long long nCk = Choose(n, k);
+  const int threadCounts[] = { 0, 1, 3, 64, };
+  for (size_t threadIdx = 0;
+       threadIdx < (sizeof(threadCounts) / sizeof(threadCounts[0]));
+       ++threadIdx)
+  {
+    // Every combination is visited once and joined in order.
+    RecordCombinations record;
+    ParallelForCombinations<RecordCombinations::MaxK>(
+      n, k, threadCounts[threadIdx], &record);
+    ASSERT_EQ(nCk, record.ms.size());
+    EXPECT_GE(record.finished, 1);
+    FixedCombinationIterator<RecordCombinations::MaxK> cmbIter(n, k, 0ULL);
+    for (unsigned long long m = 0; m < nCk; ++m)
+    {
+      cmbIter.Next();
+      EXPECT_EQ(m, record.ms[m]);
+      EXPECT_EQ(cmbIter.GetMask(), record.masks[m]);
+    }
+  }
+  // A worker that stops skips the rest of its chunk only.
+  {
+    RecordCombinations record;
+    record.stopAt = 0ULL;
+    ParallelForCombinations<RecordCombinations::MaxK>(n, k, 3, &record);
+    EXPECT_EQ(3, record.finished);
+    ASSERT_EQ(1 + (nCk - (nCk / 3)), record.ms.size());
+    EXPECT_EQ(0ULL, record.ms[0]);
+    EXPECT_EQ(nCk / 3, record.ms[1]);
+  }
+}
+
+TEST(Combination, Choose)
+{
+  // Edge cases.
+  EXPECT_EQ(0ULL, Choose(0, 0));
+  EXPECT_EQ(0ULL, Choose(5, 0));
+  EXPECT_EQ(0ULL, Choose(0, 3));
+  EXPECT_EQ(0ULL, Choose(3, 5));
+  EXPECT_EQ(1ULL, Choose(7, 7));
+  EXPECT_EQ(1832624140942590534ULL, Choose(64, 32));
+  // Multiplicative formula, as far as it does not overflow, and symmetry.
+  for (unsigned int n = 1; n <= 64; ++n)
+  {
+    unsigned long long nCk = 1ULL;
+    for (unsigned int k = 1; k <= std::min(n, 16U); ++k)
+    {
+      nCk = (nCk * (n - k + 1)) / k;
+      EXPECT_EQ(nCk, Choose(n, k));
+    }
+    for (unsigned int k = 1; k < n; ++k)
+    {
+      EXPECT_EQ(Choose(n, k), Choose(n, n - k));
+    }
+  }
+  // Factorials.
+  unsigned long long nFactorial = 1ULL;
+  EXPECT_EQ(1ULL, Factorial(0));
+  for (unsigned int n = 1; n <= 20; ++n)
+  {
+    nFactorial *= n;
+    EXPECT_EQ(nFactorial, Factorial(n));
+  }
+}
+
+TEST(Combination, RandomAccessLexicographicCombinations)
+{
+  for (unsigned int n = 1; n <= 12; ++n)
+  {
+    for (unsigned int k = 1; k <= n; ++k)
+    {
+      const RandomAccessLexicographicCombinations cmbs(n, k);
+      ASSERT_EQ(Choose(n, k), cmbs.GetCombinationCount());
+      FixedCombinationIterator<12> cmbIter(n, k, 0ULL);
+      Combination cmb;
+      for (unsigned long long m = 0; m < cmbs.GetCombinationCount(); ++m)
+      {
+        cmbIter.Next();
+        cmbs.GetCombination(m, &cmb);
+        ASSERT_EQ(static_cast<size_t>(k), cmb.size());
+        EXPECT_TRUE(std::equal(cmb.begin(), cmb.end(),
+                               cmbIter.GetCombination()));
+      }
+    }
+  }
+}
+
+TEST(Combination, FixedCombinationIterator)
+{
+  enum { MaxK = 6, };
+  const unsigned int ns[] = { 1, 5, 9, 13, 64, };
+  const unsigned int ks[] = { 1, 2, 3, 6, };
+  for (size_t nIdx = 0; nIdx < (sizeof(ns) / sizeof(ns[0])); ++nIdx)
+  {
+    for (size_t kIdx = 0; kIdx < (sizeof(ks) / sizeof(ks[0])); ++kIdx)
+    {
+      const unsigned int n = ns[nIdx];
+      const unsigned int k = ks[kIdx];
+      if ((k > n) || (Choose(n, k) > 100000ULL))
+      {
+        continue;
+      }
+      // Starting anywhere gives the lexicographic order, wrapping around.
+      const unsigned long long nCk = Choose(n, k);
+      const unsigned long long nextMs[] = { 0ULL, nCk / 3, nCk - 1, };
+      for (size_t mIdx = 0; mIdx < (sizeof(nextMs) / sizeof(nextMs[0])); ++mIdx)
+      {
+        FixedCombinationIterator<MaxK> cmbIter(n, k, nextMs[mIdx]);
+        Combination expected;
+        Combination prev;
+        for (unsigned long long step = 0; step <= nCk; ++step)
+        {
+          const unsigned long long m = cmbIter.Next();
+          ASSERT_EQ((nextMs[mIdx] + step) % nCk, m);
+          LexicographicCombination(n, k, m, &expected);
+          unsigned long long mask = 0ULL;
+          for (unsigned int member = 0; member < k; ++member)
+          {
+            ASSERT_EQ(expected[member], cmbIter[member]);
+            mask |= (1ULL << expected[member]);
+          }
+          EXPECT_EQ(mask, cmbIter.GetMask());
+          // Members before the first changed one are kept.
+          if ((step > 0) && (nCk > 1))
+          {
+            const unsigned int firstChanged = cmbIter.GetFirstChanged();
+            ASSERT_LT(firstChanged, k);
+            for (unsigned int member = 0; member < firstChanged; ++member)
+            {
+              EXPECT_EQ(prev[member], expected[member]);
+            }
+            EXPECT_NE(prev[firstChanged], expected[firstChanged]);
+          }
+          prev = expected;
+        }
+      }
+      // The vector wrapper agrees.
+      FastCombinationIterator fastIter(n, k, 0ULL);
+      FixedCombinationIterator<MaxK> cmbIter(n, k, 0ULL);
+      Combination cmb;
+      unsigned long long m;
+      for (unsigned long long step = 0; step < nCk; ++step)
+      {
+        fastIter.Next(&m, &cmb);
+        EXPECT_EQ(cmbIter.Next(), m);
+        ASSERT_EQ(static_cast<size_t>(k), cmb.size());
+        EXPECT_TRUE(std::equal(cmb.begin(), cmb.end(),
+                               cmbIter.GetCombination()));
+      }
+    }
+  }
+}
+
+}
+
+#endif //_MATH_COMBINATION_GTEST_H_
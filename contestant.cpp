@@ -1,5 +1,7 @@
 #include "contestant_util.h"
 #include "ntg.h"
+#include "opening_book.h"
+#include "win_state_table.h"
 #include <iostream>
 
 #ifdef WIN32
@@ -18,6 +20,11 @@ int main(int /*argc*/, char** /*argv*/)
 #else
   sleep(1);
 #endif
+  // Use prebuilt win states when available. Without them the player
+  // generates its own for each move.
+  LoadWinStateTable(WinStateTable::DefaultFilename());
+  // Play the first plys from the book when available.
+  LoadOpeningBook(OpeningBook::DefaultFilename());
   // Load statebuffer from status sting.
   State stateBuffer;
   while (BuildState(std::cin, &stateBuffer))
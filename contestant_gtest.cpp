@@ -1,4 +1,5 @@
 #include "contestant_util_gtest.h"
+#include "rand_bound.h"
 #include "gtest/gtest.h"
 #ifdef WIN32
 #include <time.h>
@@ -8,7 +9,7 @@
 
 int main(int argc, char** argv)
 {
-  srand(static_cast<unsigned int>(time(NULL)));
+  hps::DefaultRandomEngine().Seed(static_cast<unsigned long long>(time(NULL)));
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
@@ -1,6 +1,8 @@
 #include "contestant_util.h"
 #include "ntg.h"
 #include "ntg_players.h"
+#include "opening_book.h"
+#include "win_state_table.h"
 #include <string>
 #include <sstream>
 
@@ -16,6 +18,132 @@ namespace hps
 namespace ntg
 {
 
+namespace detail
+{
+/// <summary> Win states shared by every move of the contestant. </summary>
+WinStateTable s_winStateTable;
+/// <summary> Book plys shared by every move of the contestant. </summary>
+OpeningBook s_openingBook;
+/// <summary> Engine kept for every move of the contestant. </summary>
+ContestantEngine s_engine(&s_winStateTable, &s_openingBook);
+}
+
+bool LoadWinStateTable(const char* filename)
+{
+  return detail::s_winStateTable.Load(filename);
+}
+
+bool LoadOpeningBook(const char* filename)
+{
+  return detail::s_openingBook.Load(filename);
+}
+
+ContestantEngine::ContestantEngine(const WinStateTable* table,
+                                   const OpeningBook* book)
+  : m_table(table),
+    m_book(book),
+    m_last(),
+    m_games(0),
+    m_timeManager()
+{
+  m_players[0] = NULL;
+  m_players[1] = NULL;
+  InitState(&m_last);
+}
+
+ContestantEngine::~ContestantEngine()
+{
+  delete m_players[0];
+  delete m_players[1];
+}
+
+int ContestantEngine::Progress(const State& state)
+{
+  int occupied = 0;
+  for (const Weight* w = state.board.begin(); w != state.board.end(); ++w)
+  {
+    occupied += (Board::Empty != *w);
+  }
+  // Adding fills the board and removing empties it again.
+  if (State::Phase_Adding == state.phase)
+  {
+    return occupied - detail::Board_InitWeights;
+  }
+  return State::NumAdded + (State::NumRemoved - occupied);
+}
+
+bool ContestantEngine::Continues(const State& last, const State& state)
+{
+  if ((last.turn != state.turn) || (Progress(state) <= Progress(last)) ||
+      ((State::Phase_Removing == last.phase) &&
+       (State::Phase_Adding == state.phase)))
+  {
+    return false;
+  }
+  // Weights never move, are only added while adding and are only removed
+  // while removing.
+  const bool adding = (State::Phase_Adding == state.phase);
+  const bool removing = (State::Phase_Removing == last.phase);
+  for (const Weight *lastW = last.board.begin(), *w = state.board.begin();
+       lastW != last.board.end();
+       ++lastW, ++w)
+  {
+    if ((Board::Empty != *lastW) && (Board::Empty != *w) && (*lastW != *w))
+    {
+      return false;
+    }
+    if ((adding && (Board::Empty != *lastW) && (Board::Empty == *w)) ||
+        (removing && (Board::Empty == *lastW) && (Board::Empty != *w)))
+    {
+      return false;
+    }
+  }
+  // Played weights do not go back to the hands.
+  for (int wIdx = 0; wIdx < Player::NumWeights; ++wIdx)
+  {
+    if (((Player::Played == last.red.hand[wIdx]) &&
+         (Player::Played != state.red.hand[wIdx])) ||
+        ((Player::Played == last.blue.hand[wIdx]) &&
+         (Player::Played != state.blue.hand[wIdx])))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ContestantEngine::NextPly(State* state, Ply* ply)
+{
+  assert(state && ply);
+  const int side = (State::Turn_Red == state->turn) ? 0 : 1;
+  if ((0 == m_games) || !Continues(m_last, *state))
+  {
+    ++m_games;
+    m_timeManager.StartGame();
+    for (int playerIdx = 0; playerIdx < 2; ++playerIdx)
+    {
+      if (NULL != m_players[playerIdx])
+      {
+        m_players[playerIdx]->StartGame();
+      }
+    }
+  }
+  m_last = *state;
+  if (NULL == m_players[side])
+  {
+    m_players[side] = new AlphaBetaPruningPlayer(state->turn, m_table, m_book);
+  }
+  // Give the search its share of the game's time.
+  std::vector<Ply> plys;
+  PossiblePlys(*state, &plys);
+  const TimeManager::Deadlines deadlines =
+    m_timeManager.Allocate(*state, static_cast<int>(plys.size()));
+  m_players[side]->SetDeadlines(deadlines.soft, deadlines.hard);
+  Timer timer;
+  m_players[side]->NextPly(state, ply);
+  m_timeManager.Spend(timer.GetTime());
+}
+
 bool BuildState(std::istream& input, State* stateBuffer)
 {
   assert(stateBuffer);
@@ -213,9 +341,8 @@ std::string CalculateMoveWrapper(State* stateBuffer)
   assert(stateBuffer);
 
   // Make a move.
-  AlphaBetaPruningPlayer player(stateBuffer->turn);
   Ply ply;
-  player.NextPly(stateBuffer, &ply);
+  detail::s_engine.NextPly(stateBuffer, &ply);
   // Determing affected weight.
   int weight;
   if (stateBuffer->phase == State::Phase_Adding)
@@ -1,5 +1,6 @@
 #ifndef _HPS_NO_TIPPING_GAME_NTG_H_
 #define _HPS_NO_TIPPING_GAME_NTG_H_
+#include "time_manager.h"
 #include <iostream>
 #include <istream>
 #include <string>
@@ -9,6 +10,10 @@ namespace hps
 namespace ntg
 {
 struct State;
+struct Ply;
+struct AlphaBetaPruningPlayer;
+class WinStateTable;
+class OpeningBook;
 
 inline bool ReadMaxEmptyLines(std::istream& input,
                               const int maxEmptyLines,
@@ -29,6 +34,68 @@ inline bool ReadMaxEmptyLines(std::istream& input,
 
 bool BuildState(std::istream &input, State* stateBuffer);
 
+/// <summary> Map prebuilt win states used by CalculateMoveWrapper(). </summary>
+bool LoadWinStateTable(const char* filename);
+
+/// <summary> Map the opening book used by CalculateMoveWrapper(). </summary>
+bool LoadOpeningBook(const char* filename);
+
+/// <summary> Plays the contestant's moves with players kept across moves. </summary>
+/// <remarks>
+///   <para> One player is built for each side the first time it moves and
+///     kept, so its thread data, ply buffers and node rates carry over to
+///     later moves and games. A state that could not follow the last one
+///     starts a new game, which takes the players back to their initial win
+///     states.
+///   </para>
+///   <para> The time manager tracks the time used in the game and sets the
+///     deadlines of each search.
+///   </para>
+/// </remarks>
+class ContestantEngine
+{
+public:
+  ContestantEngine(const WinStateTable* table, const OpeningBook* book);
+  ~ContestantEngine();
+
+  /// <summary> Get the ply for the side to move. </summary>
+  void NextPly(State* state, Ply* ply);
+
+  /// <summary> Plys played before the state, as far as the board tells. </summary>
+  static int Progress(const State& state);
+
+  /// <summary> Test that the state can be reached from the last state of the
+  ///   same side in one game.
+  /// </summary>
+  static bool Continues(const State& last, const State& state);
+
+  inline int GetGames() const
+  {
+    return m_games;
+  }
+  /// <summary> Get the player of a side, NULL before the side has moved. </summary>
+  inline const AlphaBetaPruningPlayer* GetPlayer(const State::Turn side) const
+  {
+    return m_players[(State::Turn_Red == side) ? 0 : 1];
+  }
+  inline TimeManager& GetTimeManager()
+  {
+    return m_timeManager;
+  }
+
+private:
+  // Not copyable.
+  ContestantEngine(const ContestantEngine&);
+  ContestantEngine& operator=(const ContestantEngine&);
+
+  const WinStateTable* m_table;
+  const OpeningBook* m_book;
+  AlphaBetaPruningPlayer* m_players[2];
+  State m_last;
+  int m_games;
+  TimeManager m_timeManager;
+};
+
 std::string CalculateMoveWrapper(State* stateBuffer);
 
 }
@@ -2,9 +2,13 @@
 #define _HPS_NO_TIPPING_CONTESTANT_UTIL_GTEST_H_
 #include "contestant_util.h"
 #include "ntg.h"
+#include "ntg_gtest_utils.h"
+#include "ntg_players.h"
+#include "win_state_table.h"
 #include "gtest/gtest.h"
 #include "gtest/gtest.h"
 #include <fstream>
+#include <vector>
 #include <omp.h>
 
 namespace _hps_no_tipping_contestant_util_gtest_h_
@@ -42,6 +46,121 @@ TEST(contestant_util, BuildState)
   ASSERT_TRUE(BuildState(ssStateString, &state));
 }
 
+namespace detail
+{
+bool IsPossiblePly(const State& state, const Ply& ply)
+{
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  for (std::vector<Ply>::const_iterator possible = plys.begin();
+       possible != plys.end();
+       ++possible)
+  {
+    if ((possible->pos == ply.pos) && (possible->wIdx == ply.wIdx))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SameWinStates(const BoardEvaluationReachableWinStates& lhs,
+                   const BoardEvaluationReachableWinStates& rhs)
+{
+  typedef BoardEvaluationReachableWinStates::WinStateList WinStateList;
+  if ((lhs.totalRedWinStates != rhs.totalRedWinStates) ||
+      (lhs.totalBlueWinStates != rhs.totalBlueWinStates))
+  {
+    return false;
+  }
+  const WinStateList* lhsLists[] = { &lhs.redWinStates, &lhs.blueWinStates };
+  const WinStateList* rhsLists[] = { &rhs.redWinStates, &rhs.blueWinStates };
+  for (int listIdx = 0; listIdx < 2; ++listIdx)
+  {
+    if (lhsLists[listIdx]->size() != rhsLists[listIdx]->size())
+    {
+      return false;
+    }
+    for (WinStateList::const_iterator lhsLayer = lhsLists[listIdx]->begin(),
+                                      rhsLayer = rhsLists[listIdx]->begin();
+         lhsLayer != lhsLists[listIdx]->end();
+         ++lhsLayer, ++rhsLayer)
+    {
+      if ((lhsLayer->numWeights != rhsLayer->numWeights) ||
+          (lhsLayer->Size() != rhsLayer->Size()) ||
+          !std::equal(lhsLayer->Begin(), lhsLayer->End(), rhsLayer->Begin()))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+}
+
+TEST(contestant_util, ContestantEngine)
+{
+  WinStateTable table;
+  ContestantEngine engine(&table, NULL);
+  EXPECT_EQ(0, engine.GetGames());
+  std::stringstream ssStateString(stateString);
+  State state;
+  ASSERT_TRUE(BuildState(ssStateString, &state));
+  const State initialState = state;
+  EXPECT_EQ(0, ContestantEngine::Progress(state));
+  // Two of our moves with an opponent move between them are one game.
+  Ply ply;
+  engine.NextPly(&state, &ply);
+  EXPECT_EQ(1, engine.GetGames());
+  ASSERT_TRUE(detail::IsPossiblePly(state, ply));
+  DoPly(ply, &state);
+  EXPECT_EQ(1, ContestantEngine::Progress(state));
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  ASSERT_FALSE(plys.empty());
+  DoPly(plys.front(), &state);
+  EXPECT_EQ(2, ContestantEngine::Progress(state));
+  EXPECT_TRUE(ContestantEngine::Continues(initialState, state));
+  engine.NextPly(&state, &ply);
+  EXPECT_EQ(1, engine.GetGames());
+  EXPECT_TRUE(detail::IsPossiblePly(state, ply));
+  // A weight that moved cannot be the same game.
+  {
+    State moved = state;
+    for (int pos = -Board::Size; pos < Board::Size; ++pos)
+    {
+      if ((Board::Empty != moved.board[pos]) &&
+          (Board::Empty == moved.board[pos + 1]))
+      {
+        moved.board[pos + 1] = moved.board[pos];
+        moved.board[pos] = Board::Empty;
+        break;
+      }
+    }
+    EXPECT_FALSE(ContestantEngine::Continues(state, moved));
+  }
+  // Going back to the start is a new game.
+  state = initialState;
+  engine.NextPly(&state, &ply);
+  EXPECT_EQ(2, engine.GetGames());
+  EXPECT_TRUE(detail::IsPossiblePly(state, ply));
+  // The phase change replaces the initial win states, and a new game must
+  // bring them back.
+  State removingState;
+  RandomRemovingPhase(&removingState);
+  engine.NextPly(&removingState, &ply);
+  const int games = engine.GetGames();
+  state = initialState;
+  engine.NextPly(&state, &ply);
+  EXPECT_EQ(games + 1, engine.GetGames());
+  AlphaBetaPruningPlayer fresh(state.turn, &table, NULL);
+  Ply freshPly;
+  fresh.NextPly(&state, &freshPly);
+  const AlphaBetaPruningPlayer* player = engine.GetPlayer(state.turn);
+  ASSERT_TRUE(NULL != player);
+  EXPECT_TRUE(detail::SameWinStates(fresh.evalFunc, player->evalFunc));
+}
+
 TEST(contestant_util, CalculateMoveWrapper)
 {
   omp_set_num_threads(omp_get_num_procs());
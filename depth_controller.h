@@ -0,0 +1,190 @@
+#ifndef _NO_TIPPING_GAME_DEPTH_CONTROLLER_H_
+#define _NO_TIPPING_GAME_DEPTH_CONTROLLER_H_
+#include "ntg.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace hps
+{
+namespace ntg
+{
+
+/// <summary> Chooses search depths that fit a time allowance per move. </summary>
+/// <remarks>
+///   <para> A search of depth d from a state with b plys is modeled as a
+///     multiple of the minimal alpha-beta tree, b^ceil(d/2) + b^floor(d/2).
+///     This follows the growth of the search, which alternates between
+///     cheap and costly depths. Each search records, for its phase, the node
+///     rate and the multiple it took. The deepest depth predicted to
+///     finish within maxTime is chosen. Until a phase has been measured the
+///     caller's depth is kept.
+///   </para>
+///   <para> Depths are not predicted more than MaxDepthStep past the last
+///     measured depth, so a cheap search only deepens the next one a little.
+///   </para>
+/// </remarks>
+struct DepthController
+{
+  /// <summary> The searches need a depth of at least two. </summary>
+  enum { MinDepth = 2, };
+  enum { MaxDepthStep = 2, };
+
+  /// <summary> The last measured search of a phase. </summary>
+  struct PhaseEstimate
+  {
+    PhaseEstimate()
+      : depth(0),
+        scale(0.0)
+    {}
+
+    int depth;
+    /// <summary> Nodes searched over nodes in the minimal tree. </summary>
+    double scale;
+  };
+
+  DepthController()
+    : maxTime(1.0),
+      estimates(),
+      plys()
+  {
+    nodeRates[State::Phase_Adding] = 0.0;
+    nodeRates[State::Phase_Removing] = 0.0;
+  }
+
+  /// <summary> Plys that may still be played from the state. </summary>
+  static int PlysLeft(const State& state)
+  {
+    if (State::Phase_Adding == state.phase)
+    {
+      return state.red.remain + state.blue.remain + State::NumRemoved;
+    }
+    int weights = 0;
+    for (Board::const_iterator w = state.board.begin();
+         w != state.board.end();
+         ++w)
+    {
+      weights += (Board::Empty != *w);
+    }
+    return weights;
+  }
+
+  /// <summary> Nodes in the minimal alpha-beta tree of the depth. </summary>
+  static inline double MinimalTreeNodes(const int numPlys, const int depth)
+  {
+    const double b = std::max(numPlys, 2);
+    return std::pow(b, static_cast<double>((depth + 1) / 2)) +
+           std::pow(b, static_cast<double>(depth / 2)) - 1.0;
+  }
+
+  /// <summary> Seconds expected for a search of the depth from the state,
+  ///   zero until the phase is measured.
+  /// </summary>
+  double PredictTime(const State& state, const int depth)
+  {
+    return PredictTime(state.phase, NumPlys(state),
+                       std::min(depth, PlysLeft(state)));
+  }
+
+  /// <summary> Get the deepest depth that fits maxTime for the state. </summary>
+  int Choose(const State& state, const int depth)
+  {
+    const PhaseEstimate& estimate = estimates[state.phase];
+    if ((estimate.depth <= 0) || (nodeRates[state.phase] <= 0.0))
+    {
+      return depth;
+    }
+    const int maxDepth = std::max(static_cast<int>(MinDepth),
+                                  std::min(PlysLeft(state),
+                                           estimate.depth + MaxDepthStep));
+    const int numPlys = NumPlys(state);
+    int chosen = MinDepth;
+    while ((chosen < maxDepth) &&
+           (PredictTime(state.phase, numPlys, chosen + 1) <= maxTime))
+    {
+      ++chosen;
+    }
+    return chosen;
+  }
+
+  /// <summary> Drop the phase estimates, which only hold for the positions
+  ///   of one game, and keep the node rates.
+  /// </summary>
+  void ForgetEstimates()
+  {
+    estimates[State::Phase_Adding] = PhaseEstimate();
+    estimates[State::Phase_Removing] = PhaseEstimate();
+  }
+
+  /// <summary> Record a search of the depth from the state. </summary>
+  /// <remarks>
+  ///   <para> An aborted search may be recorded too. Its nodes are fewer
+  ///     than the full search would visit, so the estimate only rises to a
+  ///     lower bound of the true cost.
+  ///   </para>
+  /// </remarks>
+  void Record(const State& state,
+              const int depth,
+              const unsigned long long nodes,
+              const double seconds)
+  {
+    // The tree ends with the game.
+    const int effectiveDepth = std::min(depth, PlysLeft(state));
+    if ((effectiveDepth <= 0) || (nodes < 2ULL))
+    {
+      return;
+    }
+    const double nodeCount = static_cast<double>(nodes);
+    // Searches too short to time only tell the tree size.
+    if (seconds >= MinSampleTime())
+    {
+      const double rate = nodeCount / seconds;
+      double& nodeRate = nodeRates[state.phase];
+      nodeRate = (nodeRate > 0.0) ? (0.5 * (nodeRate + rate)) : rate;
+    }
+    PhaseEstimate& estimate = estimates[state.phase];
+    estimate.depth = effectiveDepth;
+    estimate.scale = nodeCount /
+                     MinimalTreeNodes(NumPlys(state), effectiveDepth);
+  }
+
+  static inline double MinSampleTime()
+  {
+    return 0.001;
+  }
+
+  /// <summary> Seconds allowed per search. </summary>
+  double maxTime;
+  /// <summary> Smoothed nodes searched per second in each phase. </summary>
+  double nodeRates[2];
+  PhaseEstimate estimates[2];
+
+private:
+  int NumPlys(const State& state)
+  {
+    plys.clear();
+    PossiblePlys(state, &plys);
+    return static_cast<int>(plys.size());
+  }
+
+  double PredictTime(const State::Phase phase,
+                     const int numPlys,
+                     const int depth) const
+  {
+    const PhaseEstimate& estimate = estimates[phase];
+    if ((estimate.depth <= 0) || (nodeRates[phase] <= 0.0))
+    {
+      return 0.0;
+    }
+    return (estimate.scale * MinimalTreeNodes(numPlys, depth)) /
+           nodeRates[phase];
+  }
+
+  std::vector<Ply> plys;
+};
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_DEPTH_CONTROLLER_H_
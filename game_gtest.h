@@ -108,6 +108,55 @@ struct PlayerBattle
   }
 };
 
+TEST(ntg_players, MonteCarloPlyTally)
+{
+  // Every first ply has its own tally entry.
+  {
+    typedef MonteCarloPlayer::PlyTally PlyTally;
+    State state;
+    InitState(&state);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    std::vector<int> hits(PlyTally::Size, 0);
+    for (std::vector<Ply>::const_iterator ply = plys.begin();
+         ply != plys.end();
+         ++ply)
+    {
+      const int plyIdx = PlyTally::Index(*ply);
+      ASSERT_GE(plyIdx, 0);
+      ASSERT_LT(plyIdx, static_cast<int>(PlyTally::Size));
+      EXPECT_EQ(0, hits[plyIdx]++);
+    }
+  }
+  // Every trial is tallied and the ply is a legal one.
+  for (int batchPlayouts = 0; batchPlayouts < 2; ++batchPlayouts)
+  {
+    MonteCarloPlayer player(State::Turn_Red);
+    player.maxTime = 0.05;
+    player.batchPlayouts = (1 == batchPlayouts);
+    State state;
+    InitState(&state);
+    Ply ply;
+    player.NextPly(&state, &ply);
+    int visits = 0;
+    for (int plyIdx = 0; plyIdx < MonteCarloPlayer::PlyTally::Size; ++plyIdx)
+    {
+      EXPECT_LE(player.tally.wins[plyIdx], player.tally.visits[plyIdx]);
+      visits += player.tally.visits[plyIdx];
+    }
+    EXPECT_EQ(player.trials, visits);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    bool found = false;
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      found |= (plys[plyIdx].pos == ply.pos) &&
+               (plys[plyIdx].wIdx == ply.wIdx);
+    }
+    EXPECT_TRUE(found);
+  }
+}
+
 TEST(NoTippingGames, RandomVsRandom)
 {
   enum { Games = 100, };
@@ -197,6 +246,17 @@ TEST(NoTippingGames, DISABLED_MinimaxVsMonteCarlo)
   EXPECT_NEAR(1.0f, redWinProportion, 0.01f);
 }
 
+TEST(NoTippingGames, DISABLED_RandomVsMonteCarloTreeSearch)
+{
+  enum { Games = 10, };
+  int redWins;
+  PlayerBattle<RandomPlayer, MonteCarloTreeSearchPlayer, Games>::Play(&redWins);
+  std::cout << "Red won " << redWins << " times out of "
+            << Games << " games." << std::endl;
+  const float redWinProportion = static_cast<float>(redWins) / Games;
+  EXPECT_NEAR(0.0f, redWinProportion, 0.01f);
+}
+
 }
 
 #endif //_NO_TIPPING_GAME_GAME_GTEST_H_
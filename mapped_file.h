@@ -0,0 +1,170 @@
+#ifndef _HPS_UTIL_MAPPED_FILE_H_
+#define _HPS_UTIL_MAPPED_FILE_H_
+#include <cstddef>
+
+#ifdef WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hps
+{
+namespace util
+{
+
+/// <summary> A read-only memory mapping of a whole file. </summary>
+/// <remarks>
+///   <para> Pages are faulted in on first access, so opening a large file
+///     costs little more than the system calls.
+///   </para>
+/// </remarks>
+class MappedFile
+{
+#ifdef WIN32
+public:
+  MappedFile()
+    : m_file(INVALID_HANDLE_VALUE),
+      m_mapping(NULL),
+      m_data(NULL),
+      m_size(0)
+  {}
+
+  bool Open(const char* filename)
+  {
+    Close();
+    m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_file)
+    {
+      return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_file, &fileSize) || (0 == fileSize.QuadPart))
+    {
+      Close();
+      return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL == m_mapping)
+    {
+      Close();
+      return false;
+    }
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (NULL == m_data)
+    {
+      Close();
+      return false;
+    }
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+  }
+
+  void Close()
+  {
+    if (NULL != m_data)
+    {
+      UnmapViewOfFile(m_data);
+      m_data = NULL;
+    }
+    if (NULL != m_mapping)
+    {
+      CloseHandle(m_mapping);
+      m_mapping = NULL;
+    }
+    if (INVALID_HANDLE_VALUE != m_file)
+    {
+      CloseHandle(m_file);
+      m_file = INVALID_HANDLE_VALUE;
+    }
+    m_size = 0;
+  }
+
+private:
+  HANDLE m_file;
+  HANDLE m_mapping;
+#else
+public:
+  MappedFile()
+    : m_data(NULL),
+      m_size(0)
+  {}
+
+  bool Open(const char* filename)
+  {
+    Close();
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat fileStat;
+    if ((0 != fstat(fd, &fileStat)) || (0 == fileStat.st_size))
+    {
+      close(fd);
+      return false;
+    }
+    void* data = mmap(NULL, static_cast<size_t>(fileStat.st_size),
+                      PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    if (MAP_FAILED == data)
+    {
+      return false;
+    }
+    m_data = data;
+    m_size = static_cast<size_t>(fileStat.st_size);
+    return true;
+  }
+
+  void Close()
+  {
+    if (NULL != m_data)
+    {
+      munmap(const_cast<void*>(m_data), m_size);
+      m_data = NULL;
+    }
+    m_size = 0;
+  }
+
+private:
+#endif
+public:
+  ~MappedFile()
+  {
+    Close();
+  }
+
+  inline bool IsOpen() const
+  {
+    return NULL != m_data;
+  }
+  inline const void* GetData() const
+  {
+    return m_data;
+  }
+  inline size_t GetSize() const
+  {
+    return m_size;
+  }
+
+private:
+  // Not copyable.
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const void* m_data;
+  size_t m_size;
+};
+
+}
+using namespace util;
+}
+
+#endif //_HPS_UTIL_MAPPED_FILE_H_
@@ -0,0 +1,365 @@
+#ifndef _NO_TIPPING_GAME_MCTS_H_
+#define _NO_TIPPING_GAME_MCTS_H_
+#include "ntg.h"
+#include "playout.h"
+#include "rand_bound.h"
+#include "timer.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace hps
+{
+namespace ntg
+{
+
+/// <summary> Monte Carlo tree search with the UCT selection rule. </summary>
+/// <remarks>
+///   <para> Each playout descends the tree by UCT, expands the node it stops
+///     at, plays random non suicidal plys to the end of the game and credits
+///     the result to every node on its path.
+///   </para>
+///   <para> Nodes live in one arena and the children of a node are created
+///     together, so they are contiguous. The tree is kept between moves. When
+///     the next state is found within two plys of the old root the subtree
+///     below it is compacted to the front of a new arena and searched
+///     further.
+///   </para>
+/// </remarks>
+struct MonteCarloTreeSearch
+{
+  /// <summary> A state reached by a ply from its parent. </summary>
+  struct Node
+  {
+    Node()
+      : ply(),
+        firstChild(-1),
+        numChildren(0),
+        visits(0),
+        wins(0)
+    {}
+    explicit Node(const Ply& ply_)
+      : ply(ply_),
+        firstChild(-1),
+        numChildren(0),
+        visits(0),
+        wins(0)
+    {}
+
+    inline bool Expanded() const
+    {
+      return firstChild >= 0;
+    }
+
+    Ply ply;
+    /// <summary> Arena index of the first child, -1 until expanded. </summary>
+    int firstChild;
+    int numChildren;
+    int visits;
+    /// <summary> Playouts won by the player who made the ply. </summary>
+    int wins;
+  };
+  typedef std::vector<Node> NodeList;
+
+  /// <summary> The search budget and the tree kept between moves. </summary>
+  struct Params
+  {
+    Params()
+      : maxTime(1.0),
+        maxPlayouts(1000000),
+        exploration(1.4),
+        maxNodes(1 << 20),
+        batchPlayouts(false),
+        nodes(),
+        rootState(),
+        playouts(0),
+        reusedVisits(0),
+        plys(),
+        path(),
+        rng(),
+        batch()
+    {}
+
+    /// <summary> Seconds to search per move. </summary>
+    double maxTime;
+    /// <summary> Playouts to run per move. </summary>
+    int maxPlayouts;
+    /// <summary> UCT exploration constant. </summary>
+    double exploration;
+    /// <summary> Nodes are not expanded past this arena size. </summary>
+    size_t maxNodes;
+    /// <summary> Play PlayoutBatch::Lanes games in lockstep from each leaf
+    ///   instead of one.
+    /// </summary>
+    bool batchPlayouts;
+    /// <summary> Node arena with the root at index 0. </summary>
+    NodeList nodes;
+    /// <summary> The state at the root. </summary>
+    State rootState;
+    /// <summary> Playouts run by the last search. </summary>
+    int playouts;
+    /// <summary> Root visits carried over by the last search. </summary>
+    int reusedVisits;
+    std::vector<Ply> plys;
+    std::vector<int> path;
+    RandomEngine rng;
+    PlayoutBatch batch;
+  };
+
+  /// <summary> Search from the state and get the most visited ply. </summary>
+  static void Run(Params* params, State* state, Ply* ply)
+  {
+    assert(params && state && ply);
+    assert(!Tipped(state->board));
+
+    Timer timer;
+    NodeList& nodes = params->nodes;
+    if (!FindRoot(*state, params))
+    {
+      nodes.assign(1, Node());
+      params->rootState = *state;
+    }
+    params->reusedVisits = nodes[0].visits;
+    // Search until the budget runs out.
+    enum { LeavesPerTimeCheck = 64, };
+    int& playouts = params->playouts;
+    playouts = 0;
+    for (int leaf = 0; playouts < params->maxPlayouts; ++leaf)
+    {
+      if ((0 == (leaf % LeavesPerTimeCheck)) && (leaf > 0) &&
+          (timer.GetTime() >= params->maxTime))
+      {
+        break;
+      }
+      playouts += Playout(params);
+    }
+    // Take the most visited ply.
+    const Node& root = nodes[0];
+    int bestVisits = -1;
+    for (int childIdx = root.firstChild;
+         childIdx < (root.firstChild + root.numChildren);
+         ++childIdx)
+    {
+      if (nodes[childIdx].visits > bestVisits)
+      {
+        bestVisits = nodes[childIdx].visits;
+        *ply = nodes[childIdx].ply;
+      }
+    }
+    // We lose.
+    if (bestVisits < 0)
+    {
+      AnyPlyWillDo(state, ply);
+    }
+  }
+
+  /// <summary> Descend from the root and play out from the leaf. </summary>
+  /// <returns> The number of games played. </returns>
+  static int Playout(Params* params)
+  {
+    assert(params);
+    NodeList& nodes = params->nodes;
+    std::vector<int>& path = params->path;
+    State state = params->rootState;
+    // Select by UCT down to a node that is not expanded.
+    path.assign(1, 0);
+    int nodeIdx = 0;
+    while (nodes[nodeIdx].Expanded() && (nodes[nodeIdx].numChildren > 0))
+    {
+      nodeIdx = SelectChild(nodes, nodeIdx, params->exploration);
+      DoPly(nodes[nodeIdx].ply, &state);
+      path.push_back(nodeIdx);
+    }
+    // Expand and step to the first child.
+    if (!nodes[nodeIdx].Expanded())
+    {
+      std::vector<Ply>& plys = params->plys;
+      plys.clear();
+      PossiblePlys(state, &plys);
+      if ((nodes.size() + plys.size()) <= params->maxNodes)
+      {
+        const int firstChild = static_cast<int>(nodes.size());
+        for (std::vector<Ply>::const_iterator childPly = plys.begin();
+             childPly != plys.end();
+             ++childPly)
+        {
+          nodes.push_back(Node(*childPly));
+        }
+        nodes[nodeIdx].firstChild = firstChild;
+        nodes[nodeIdx].numChildren = static_cast<int>(plys.size());
+        if (!plys.empty())
+        {
+          nodeIdx = firstChild;
+          DoPly(nodes[nodeIdx].ply, &state);
+          path.push_back(nodeIdx);
+        }
+      }
+    }
+    // Play out and credit the winners.
+    int games = 1;
+    int wins[] = { 0, 0, };
+    if (params->batchPlayouts)
+    {
+      PlayoutBoard board;
+      board.Load(state);
+      PlayoutBatch& batch = params->batch;
+      batch.Load(board);
+      batch.Run(&params->rng);
+      games = PlayoutBatch::Lanes;
+      for (int lane = 0; lane < PlayoutBatch::Lanes; ++lane)
+      {
+        ++wins[batch.winners[lane]];
+      }
+    }
+    else
+    {
+      ++wins[RandomPlayout(state, &params->rng)];
+    }
+    State::Turn mover = params->rootState.turn;
+    nodes[0].visits += games;
+    for (size_t pathIdx = 1; pathIdx < path.size(); ++pathIdx)
+    {
+      Node& node = nodes[path[pathIdx]];
+      node.visits += games;
+      node.wins += wins[mover];
+      NextTurn(&mover);
+    }
+    return games;
+  }
+
+  /// <summary> Get the child with the best UCT value. </summary>
+  static int SelectChild(const NodeList& nodes,
+                         const int nodeIdx,
+                         const double exploration)
+  {
+    const Node& node = nodes[nodeIdx];
+    assert(node.numChildren > 0);
+    const double logVisits = std::log(static_cast<double>(node.visits + 1));
+    int bestChild = node.firstChild;
+    double bestValue = -1.0;
+    for (int childIdx = node.firstChild;
+         childIdx < (node.firstChild + node.numChildren);
+         ++childIdx)
+    {
+      const Node& child = nodes[childIdx];
+      if (0 == child.visits)
+      {
+        return childIdx;
+      }
+      const double visits = static_cast<double>(child.visits);
+      const double value = (child.wins / visits) +
+                           (exploration * std::sqrt(logVisits / visits));
+      if (value > bestValue)
+      {
+        bestValue = value;
+        bestChild = childIdx;
+      }
+    }
+    return bestChild;
+  }
+
+  /// <summary> Play random non suicidal plys until a player has none. </summary>
+  /// <returns> The winner. </returns>
+  static State::Turn RandomPlayout(const State& state, RandomEngine* rng)
+  {
+    assert(rng);
+    PlayoutBoard board;
+    board.Load(state);
+    return board.Run(rng);
+  }
+
+  /// <summary> Test if two states are the same position. </summary>
+  static bool SameState(const State& lhs, const State& rhs)
+  {
+    return (lhs.turn == rhs.turn) &&
+           (lhs.phase == rhs.phase) &&
+           (lhs.red.remain == rhs.red.remain) &&
+           (lhs.blue.remain == rhs.blue.remain) &&
+           (0 == memcmp(lhs.red.hand, rhs.red.hand, sizeof(lhs.red.hand))) &&
+           (0 == memcmp(lhs.blue.hand, rhs.blue.hand,
+                        sizeof(lhs.blue.hand))) &&
+           std::equal(lhs.board.begin(), lhs.board.end(), rhs.board.begin());
+  }
+
+  /// <summary> Make the node for the state within two plys of the root the
+  ///   new root.
+  /// </summary>
+  /// <returns> False when the state is not in the tree. </returns>
+  static bool FindRoot(const State& state, Params* params)
+  {
+    assert(params);
+    NodeList& nodes = params->nodes;
+    if (nodes.empty())
+    {
+      return false;
+    }
+    State& rootState = params->rootState;
+    if (SameState(state, rootState))
+    {
+      return true;
+    }
+    const Node& root = nodes[0];
+    for (int childIdx = root.firstChild;
+         childIdx < (root.firstChild + root.numChildren);
+         ++childIdx)
+    {
+      const Node& child = nodes[childIdx];
+      DoPly(child.ply, &rootState);
+      if (SameState(state, rootState))
+      {
+        Reroot(childIdx, params);
+        return true;
+      }
+      for (int grandchildIdx = child.firstChild;
+           grandchildIdx < (child.firstChild + child.numChildren);
+           ++grandchildIdx)
+      {
+        DoPly(nodes[grandchildIdx].ply, &rootState);
+        if (SameState(state, rootState))
+        {
+          Reroot(grandchildIdx, params);
+          return true;
+        }
+        UndoPly(nodes[grandchildIdx].ply, &rootState);
+      }
+      UndoPly(child.ply, &rootState);
+    }
+    return false;
+  }
+
+  /// <summary> Compact the subtree below a node into a new arena. </summary>
+  /// <remarks>
+  ///   <para> The caller has already applied the plys to the new root to
+  ///     rootState. Nodes are copied breadth first, so each copy still
+  ///     holds the old index of its children until it is reached.
+  ///   </para>
+  /// </remarks>
+  static void Reroot(const int newRootIdx, Params* params)
+  {
+    assert(params);
+    const NodeList& nodes = params->nodes;
+    NodeList newNodes;
+    newNodes.reserve(nodes.size());
+    newNodes.push_back(nodes[newRootIdx]);
+    for (size_t newIdx = 0; newIdx < newNodes.size(); ++newIdx)
+    {
+      const int oldFirstChild = newNodes[newIdx].firstChild;
+      if (oldFirstChild < 0)
+      {
+        continue;
+      }
+      const int numChildren = newNodes[newIdx].numChildren;
+      newNodes[newIdx].firstChild = static_cast<int>(newNodes.size());
+      newNodes.insert(newNodes.end(),
+                      nodes.begin() + oldFirstChild,
+                      nodes.begin() + oldFirstChild + numChildren);
+    }
+    params->nodes.swap(newNodes);
+  }
+};
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_MCTS_H_
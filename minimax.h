@@ -1,6 +1,7 @@
 #ifndef _NO_TIPPING_GAME_MINIMAX_H_
 #define _NO_TIPPING_GAME_MINIMAX_H_
 #include "ntg.h"
+#include "rand_bound.h"
 #include <omp.h>
 
 namespace hps
@@ -19,7 +20,9 @@ struct Minimax
         maxDepth(-1),
         bestMinimax(0),
         bestPlyIdx(-1),
-        dfsPlys(State::NumRemoved + (2 * Player::NumWeights) - 2)
+        nodes(0ULL),
+        dfsPlys(State::NumRemoved + (2 * Player::NumWeights) - 2),
+        rng()
     {}
 
     State state;
@@ -27,7 +30,11 @@ struct Minimax
     int maxDepth;
     int bestMinimax;
     int bestPlyIdx;
+    /// <summary> States visited by this thread. </summary>
+    unsigned long long nodes;
     std::vector<std::vector<Ply> > dfsPlys;
+    /// <summary> Shuffles move order in this thread. </summary>
+    RandomEngine rng;
   };
 
   /// <summary> The parallel minimax parameters. </summary>
@@ -37,15 +44,21 @@ struct Minimax
       : maxDepthAdding(3),
         maxDepthRemoving(8),
         depth(0),
+        nodes(0ULL),
         rootPlys(),
-        threadData()
+        threadData(),
+        rng()
     {}
 
     int maxDepthAdding;
     int maxDepthRemoving;
     int depth;
+    /// <summary> States visited by the last run. </summary>
+    unsigned long long nodes;
     std::vector<Ply> rootPlys;
     std::vector<ThreadParams> threadData;
+    /// <summary> Shuffles root move order and seeds the threads. </summary>
+    RandomEngine rng;
   };
 
   /// <summary> Run Minimax to get the ply for the state. </summary>
@@ -71,12 +84,13 @@ struct Minimax
     assert(maxDepth > 1);
     assert(depth < maxDepth);
     ++depth;
+    params->nodes = 1ULL;
 
     // Get the children of the current state.
     std::vector<Ply>& plys = params->rootPlys;
     plys.clear();
     PossiblePlys(*state, &plys);
-    std::random_shuffle(plys.begin(), plys.end());
+    RandomShuffle(plys.begin(), plys.end(), &params->rng);
     // A leaf has no non-suicidal moves. Who won?
     int minimax;
     if (plys.empty())
@@ -88,7 +102,9 @@ struct Minimax
       // Setup threads.
       std::vector<ThreadParams>& threadData = params->threadData;
       {
-        const int numProcs = omp_get_num_procs();
+        // Every thread of the parallel loop needs its own data.
+        const int numProcs = std::max(omp_get_num_procs(),
+                                      omp_get_max_threads());
         threadData.resize(numProcs);
         int initMinimax = std::numeric_limits<int>::min();
         for (int threadIdx = 0; threadIdx < numProcs; ++threadIdx)
@@ -97,9 +113,11 @@ struct Minimax
           {
             threadParams.bestMinimax = initMinimax;
             threadParams.bestPlyIdx = -1;
+            threadParams.nodes = 0ULL;
             threadParams.depth = depth;
             threadParams.maxDepth = maxDepth;
             threadParams.state = *state;
+            threadParams.rng.Seed(params->rng());
           }
         }
       }
@@ -129,6 +147,13 @@ struct Minimax
         int bestPlyIdx;
         GatherRunThreadResults<std::greater<int> >(threadData,
                                                    &minimax, &bestPlyIdx);
+        for (std::vector<ThreadParams>::const_iterator threadParams =
+               threadData.begin();
+             threadParams != threadData.end();
+             ++threadParams)
+        {
+          params->nodes += threadParams->nodes;
+        }
         // Set minimax ply.
         *ply = plys[bestPlyIdx];
       }
@@ -235,12 +260,13 @@ private:
     assert(!Tipped(state->board));
     assert(depth < maxDepth);
     ++depth;
+    ++params->nodes;
 
     // Get the children of the current state.
     std::vector<Ply>& plys = params->dfsPlys[params->depth - 2];
     plys.clear();
     PossiblePlys(*state, &plys);
-    std::random_shuffle(plys.begin(), plys.end());
+    RandomShuffle(plys.begin(), plys.end(), &params->rng);
     // Is this a leaf?
     int minimax;
     if (plys.empty())
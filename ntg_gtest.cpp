@@ -1,7 +1,9 @@
 #include "rand_bound_gtest.h"
+#include "combination_gtest.h"
 #include "ntg_gtest.h"
 #include "minimax_gtest.h"
 #include "game_gtest.h"
+#include "rand_bound.h"
 #include "gtest/gtest.h"
 #ifdef WIN32
 #include <time.h>
@@ -11,7 +13,7 @@
 
 int main(int argc, char** argv)
 {
-  srand(static_cast<unsigned int>(time(NULL)));
+  hps::DefaultRandomEngine().Seed(static_cast<unsigned long long>(time(NULL)));
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
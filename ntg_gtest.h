@@ -2,10 +2,22 @@
 #define _NO_TIPPING_GAME_NTG_GTEST_H_
 #include "ntg.h"
 #include "adversarial_utils.h"
+#include "alphabetapruning.h"
+#include "depth_controller.h"
+#include "mcts.h"
+#include "playout.h"
 #include "ntg_gtest_operators.h"
 #include "ntg_gtest_utils.h"
+#include "ntg_players.h"
+#include "opening_book.h"
 #include "rand_bound.h"
+#include "time_manager.h"
+#include "win_state_table.h"
 #include "gtest/gtest.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 
 namespace _no_tipping_game_ntg_gtest_h_
 {
@@ -167,7 +179,7 @@ TEST(ntg, State)
           plyPosOrder.push_back(pos);
         }
       }
-      std::random_shuffle(plyPosOrder.begin(), plyPosOrder.end());
+      RandomShuffle(plyPosOrder.begin(), plyPosOrder.end());
     }
     std::vector<Ply> plys;
     {
@@ -213,7 +225,7 @@ TEST(ntg, State)
           removePhaseOrder.push_back(pos);
         }
       }
-      std::random_shuffle(removePhaseOrder.begin(), removePhaseOrder.end());
+      RandomShuffle(removePhaseOrder.begin(), removePhaseOrder.end());
       for (size_t plyIdx = 0; plyIdx < removePhaseOrder.size(); ++plyIdx)
       {
         plys.push_back(Ply(removePhaseOrder[plyIdx]));
@@ -461,6 +473,958 @@ TEST(adversarial_utils, WinStates)
   }
 }
 
+TEST(adversarial_utils, HashBoard)
+{
+  // Keys of disjoint sub-boards combine with XOR.
+  for (int trial = 0; trial < 100; ++trial)
+  {
+    State state;
+    RandomRemovingPhase(&state);
+    const Board& board = state.board;
+    Board lhs;
+    Board rhs;
+    ClearBoard(&lhs);
+    ClearBoard(&rhs);
+    std::vector<std::pair<int, int> > posWeightPairs;
+    for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+    {
+      if (Board::Empty != board[pos])
+      {
+        posWeightPairs.push_back(std::make_pair(pos, board[pos]));
+        Board& half = RandBound(2) ? lhs : rhs;
+        half[pos] = board[pos];
+      }
+    }
+    const unsigned long long key = HashBoard(board);
+    EXPECT_EQ(key, HashBoard(lhs) ^ HashBoard(rhs));
+    EXPECT_EQ(key, HashPosWeightPairs(static_cast<int>(posWeightPairs.size()),
+                                      &posWeightPairs[0]));
+    EXPECT_EQ(key, BoardHashKey(board).key);
+  }
+  // No collisions among the two weight win states.
+  {
+    Board initBoard;
+    InitBoard(&initBoard);
+    std::vector<Board> twoW;
+    DoubleWeightStatesNoConflictNoRemove(initBoard, &twoW);
+    std::vector<unsigned long long> keys;
+    for (size_t boardIdx = 0; boardIdx < twoW.size(); ++boardIdx)
+    {
+      keys.push_back(HashBoard(twoW[boardIdx]));
+    }
+    std::sort(keys.begin(), keys.end());
+    EXPECT_TRUE(std::adjacent_find(keys.begin(), keys.end()) == keys.end());
+  }
+}
+TEST(adversarial_utils, EvalCache)
+{
+  // Cached scores must match a fresh count before and after Update().
+  BoardEvaluationReachableWinStates evalFunc(State::Turn_Red);
+  State state;
+  RandomRemovingPhase(&state);
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      DoPly(plys[plyIdx], &state);
+      EXPECT_EQ(evalFunc.Score(state.board), evalFunc(state));
+      EXPECT_EQ(evalFunc.Score(state.board), evalFunc(state));
+      UndoPly(plys[plyIdx], &state);
+    }
+    evalFunc.Update(state, 1, 5);
+  }
+  const BoardEvaluationReachableWinStates::EvalCache& cache =
+    evalFunc.evalCaches[0];
+  EXPECT_EQ(2 * plys.size(), cache.hits);
+  EXPECT_EQ(2 * plys.size(), cache.misses);
+}
+
+TEST(adversarial_utils, SubsetTorqueBatch)
+{
+  // Batched tests must agree with testing each sub-board with Tipped().
+  State state;
+  RandomRemovingPhase(&state);
+  std::vector<int> positions;
+  int slotTorqueL[Board::Positions];
+  int slotTorqueR[Board::Positions];
+  for (int pos = -Board::Size; pos <= Board::Size; ++pos)
+  {
+    if (Board::Empty != state.board[pos])
+    {
+      ntg::detail::SubsetTorqueBatch::Contributions(
+        pos, state.board[pos],
+        slotTorqueL + positions.size(), slotTorqueR + positions.size());
+      positions.push_back(pos);
+    }
+  }
+  enum { NumMembers = 3, };
+  const RandomAccessLexicographicCombinations cmbs(
+    static_cast<unsigned int>(positions.size()), NumMembers);
+  const int numCmbs = static_cast<int>(cmbs.GetCombinationCount());
+  ntg::detail::SubsetTorqueBatch batch(NumMembers);
+  std::vector<bool> expectWin;
+  int wins = 0;
+  for (int cmbIdx = 0; cmbIdx < numCmbs; ++cmbIdx)
+  {
+    Combination cmb;
+    cmbs.GetCombination(cmbIdx, &cmb);
+    Board testBoard;
+    ClearBoard(&testBoard);
+    int cmbPositions[NumMembers];
+    for (int member = 0; member < NumMembers; ++member)
+    {
+      cmbPositions[member] = positions[cmb[member]];
+      testBoard[cmbPositions[member]] = state.board[cmbPositions[member]];
+    }
+    expectWin.push_back(!Tipped(testBoard) &&
+                        ntg::detail::AllRemovalsTip(NumMembers, cmbPositions,
+                                               &testBoard));
+    batch.Add(&cmb[0], slotTorqueL, slotTorqueR, 0ULL);
+    if (batch.Full() || ((cmbIdx + 1) == numCmbs))
+    {
+      const unsigned long long winLanes = batch.WinStateLanes();
+      for (int lane = 0; lane < batch.lanes; ++lane)
+      {
+        const bool win = (0ULL != (winLanes & (1ULL << lane)));
+        EXPECT_EQ(expectWin[lane], win);
+        wins += win;
+      }
+      expectWin.clear();
+      batch.Clear();
+    }
+  }
+  std::cout << "Found " << wins << " win states among " << numCmbs
+            << " sub-boards." << std::endl;
+}
+
+TEST(adversarial_utils, IncrementalCounts)
+{
+  // Incremental counts must match a recount along a game and its siblings.
+  BoardEvaluationReachableWinStates evalFunc(State::Turn_Blue);
+  BoardEvaluationReachableWinStates::IncrementalCounts counts;
+  State state;
+  InitState(&state);
+  std::vector<Ply> plys;
+  for (int turn = 0;; ++turn)
+  {
+    plys.clear();
+    PossiblePlys(state, &plys);
+    if (plys.empty())
+    {
+      break;
+    }
+    if ((20 == turn) || (26 == turn))
+    {
+      evalFunc.Update(state, 1, 6);
+    }
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      DoPly(plys[plyIdx], &state);
+      EXPECT_EQ(evalFunc.Score(state.board),
+                evalFunc.ScoreIncremental(state.board, &counts));
+      UndoPly(plys[plyIdx], &state);
+    }
+    DoPly(plys[RandBound(static_cast<int>(plys.size()))], &state);
+  }
+}
+
+TEST(adversarial_utils, ReachableDirections)
+{
+  // Probing subsets and testing containment must count the same states.
+  typedef BoardEvaluationReachableWinStates EvalFunc;
+  EvalFunc evalFunc(State::Turn_Red);
+  State state;
+  RandomRemovingPhase(&state);
+  evalFunc.Update(state, 1, 6);
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  const EvalFunc::WinStateList* lists[] = { &evalFunc.redWinStates,
+                                            &evalFunc.blueWinStates };
+  for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+  {
+    DoPly(plys[plyIdx], &state);
+    int positionsOccupied;
+    int positions[Board::Positions];
+    EvalFunc::CollectOccupiedPositions(state.board, &positionsOccupied,
+                                       positions);
+    unsigned long long slotKeys[Board::Positions];
+    EvalFunc::CollectOccupiedKeys(state.board, positionsOccupied, positions,
+                                  slotKeys);
+    const PackedBoard packedBoard(state.board);
+    for (int listIdx = 0; listIdx < 2; ++listIdx)
+    {
+      for (EvalFunc::WinStateList::const_iterator winState =
+             lists[listIdx]->begin();
+           winState != lists[listIdx]->end();
+           ++winState)
+      {
+        if (positionsOccupied < winState->numWeights)
+        {
+          continue;
+        }
+        EXPECT_EQ(EvalFunc::CountSubsetStates(*winState, positionsOccupied,
+                                              slotKeys),
+                  EvalFunc::CountContainedStates(*winState, packedBoard));
+      }
+    }
+    UndoPly(plys[plyIdx], &state);
+  }
+}
+
+TEST(adversarial_utils, RequestedLayers)
+{
+  typedef BoardEvaluationReachableWinStates EvalFunc;
+  State state;
+  RandomRemovingPhase(&state);
+  // Every requested layer is built before Update() returns.
+  {
+    EvalFunc evalFunc(State::Turn_Red);
+    evalFunc.Update(state, 3, 7);
+    EXPECT_EQ(0ULL, evalFunc.requestedLayers);
+    EXPECT_EQ(0ULL, evalFunc.builtLayers);
+    const EvalFunc::WinStateList* lists[] = { &evalFunc.redWinStates,
+                                              &evalFunc.blueWinStates };
+    for (int numWeights = 3; numWeights < 7; ++numWeights)
+    {
+      const EvalFunc::WinStateList& winStates = *lists[numWeights & 1];
+      bool found = false;
+      for (EvalFunc::WinStateList::const_iterator winState = winStates.begin();
+           winState != winStates.end();
+           ++winState)
+      {
+        found = found || (numWeights == winState->numWeights);
+      }
+      EXPECT_TRUE(found);
+    }
+  }
+  // Layers built in the background agree once waited for.
+  {
+    EvalFunc background(State::Turn_Red);
+    background.backgroundLayers = true;
+    EvalFunc eager(State::Turn_Red);
+    background.Update(state, 1, 7);
+    eager.Update(state, 1, 7);
+    background.WaitForLayers();
+    EXPECT_EQ(eager.totalRedWinStates, background.totalRedWinStates);
+    EXPECT_EQ(eager.totalBlueWinStates, background.totalBlueWinStates);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      DoPly(plys[plyIdx], &state);
+      EXPECT_EQ(eager(state), background(state));
+      UndoPly(plys[plyIdx], &state);
+    }
+  }
+}
+
+TEST(adversarial_utils, EytzingerKeys)
+{
+  typedef BoardEvaluationReachableWinStates EvalFunc;
+  EvalFunc evalFunc(State::Turn_Red);
+  // Every key is found and keys between them are not.
+  const EvalFunc::WinStateList* lists[] = { &evalFunc.redWinStates,
+                                            &evalFunc.blueWinStates };
+  for (int listIdx = 0; listIdx < 2; ++listIdx)
+  {
+    for (EvalFunc::WinStateList::const_iterator winState =
+           lists[listIdx]->begin();
+         winState != lists[listIdx]->end();
+         ++winState)
+    {
+      ASSERT_EQ(winState->Size() + 1, winState->eytzinger.size());
+      for (const BoardHashKey* key = winState->Begin();
+           key != winState->End();
+           ++key)
+      {
+        EXPECT_TRUE(winState->EytzingerContains(*key));
+        const BoardHashKey nextKey(key->key + 1ULL);
+        EXPECT_EQ(std::binary_search(winState->Begin(), winState->End(),
+                                     nextKey),
+                  winState->EytzingerContains(nextKey));
+      }
+      EXPECT_FALSE(winState->EytzingerContains(BoardHashKey(0ULL)));
+    }
+  }
+  // Scores do not depend on the search.
+  EvalFunc binaryEvalFunc(State::Turn_Red);
+  binaryEvalFunc.SetKeySearch(EvalFunc::KeySearch_Binary);
+  // Only the Eytzinger search keeps a second copy of the keys.
+  {
+    EvalFunc::NumWeightsWinStates layer;
+    EXPECT_TRUE(NULL == layer.FilterBegin());
+    layer.numWeights = 1;
+    layer.states = evalFunc.blueWinStates.front().states;
+    layer.Finalize();
+    EXPECT_TRUE(layer.eytzinger.empty());
+  }
+  EXPECT_TRUE(binaryEvalFunc.redWinStates.front().eytzinger.empty());
+  EXPECT_FALSE(evalFunc.redWinStates.front().eytzinger.empty());
+  binaryEvalFunc.evalMode = EvalFunc::EvalMode_Recount;
+  evalFunc.evalMode = EvalFunc::EvalMode_Recount;
+  for (int trial = 0; trial < 10; ++trial)
+  {
+    State state;
+    RandomRemovingPhase(&state);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      DoPly(plys[plyIdx], &state);
+      EXPECT_EQ(binaryEvalFunc(state), evalFunc(state));
+      UndoPly(plys[plyIdx], &state);
+    }
+  }
+}
+
+TEST(adversarial_utils, SampledCounts)
+{
+  typedef BoardEvaluationReachableWinStates EvalFunc;
+  EvalFunc evalFunc(State::Turn_Red);
+  State state;
+  RandomRemovingPhase(&state);
+  evalFunc.Update(state, 1, 7);
+  EvalFunc::LayerSnapshot snapshot;
+  evalFunc.TakeSnapshot(&snapshot);
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+  {
+    DoPly(plys[plyIdx], &state);
+    // Layers cheaper than the samples are counted exactly.
+    evalFunc.samplesPerLayer = 1 << 30;
+    const int score = evalFunc.Score(state.board, snapshot);
+    EXPECT_EQ(score, evalFunc.ScoreSampled(state.board, snapshot));
+    // Estimates are repeatable.
+    evalFunc.samplesPerLayer = 16;
+    EXPECT_EQ(evalFunc.ScoreSampled(state.board, snapshot),
+              evalFunc.ScoreSampled(state.board, snapshot));
+    UndoPly(plys[plyIdx], &state);
+  }
+  // Estimates approach the count as samples grow.
+  enum { Samples = 1 << 16, };
+  int positionsOccupied;
+  int positions[Board::Positions];
+  EvalFunc::CollectOccupiedPositions(state.board, &positionsOccupied,
+                                     positions);
+  unsigned long long slotKeys[Board::Positions];
+  EvalFunc::CollectOccupiedKeys(state.board, positionsOccupied, positions,
+                                slotKeys);
+  const EvalFunc::WinStateList* lists[] = { &evalFunc.redWinStates,
+                                            &evalFunc.blueWinStates };
+  for (int listIdx = 0; listIdx < 2; ++listIdx)
+  {
+    for (EvalFunc::WinStateList::const_iterator winState =
+           lists[listIdx]->begin();
+         winState != lists[listIdx]->end();
+         ++winState)
+    {
+      if (positionsOccupied < winState->numWeights)
+      {
+        continue;
+      }
+      const int count = EvalFunc::CountSubsetStates(*winState,
+                                                    positionsOccupied,
+                                                    slotKeys);
+      const unsigned long long cmbCount =
+        Choose(positionsOccupied, winState->numWeights);
+      unsigned long long seed = 1ULL;
+      const int estimate = EvalFunc::CountSampledStates(
+        *winState, positionsOccupied, slotKeys, cmbCount, Samples, &seed);
+      // Within five standard deviations of the binomial estimate.
+      const double variance = (static_cast<double>(count) *
+                               static_cast<double>(cmbCount - count)) /
+                              Samples;
+      EXPECT_NEAR(count, estimate, (5.0 * std::sqrt(variance)) + 2.0);
+    }
+  }
+}
+
+TEST(adversarial_utils, WinStateTable)
+{
+  // A written table must load and score like generated win states.
+  const char* filename = "ntg_gtest_winstates.bin";
+  enum { NumLayers = WinStateTable::DefaultMaxWeights, };
+  ASSERT_TRUE(WriteStandardWinStateTable(filename, NumLayers));
+  {
+    WinStateTable table;
+    ASSERT_TRUE(table.Load(filename));
+    ASSERT_EQ(static_cast<size_t>(NumLayers), table.GetLayers().size());
+    for (int layerIdx = 0; layerIdx < NumLayers; ++layerIdx)
+    {
+      const WinStateTable::Layer& layer = table.GetLayers()[layerIdx];
+      EXPECT_EQ(layerIdx + 1, layer.numWeights);
+      EXPECT_GT(layer.stateCount, 0U);
+      EXPECT_TRUE(std::adjacent_find(layer.states,
+                                     layer.states + layer.stateCount,
+                                     std::greater_equal<unsigned long long>()) ==
+                  (layer.states + layer.stateCount));
+    }
+    BoardEvaluationReachableWinStates generated(State::Turn_Red);
+    BoardEvaluationReachableWinStates mapped(State::Turn_Red, &table);
+    // Only the table has the larger layers before Update().
+    const WinStateTable::Layer& largest = table.GetLayers().back();
+    EXPECT_EQ(generated.totalRedWinStates, mapped.totalRedWinStates);
+    EXPECT_EQ(generated.totalBlueWinStates + static_cast<int>(largest.stateCount),
+              mapped.totalBlueWinStates);
+    // The touching index is mapped rather than rebuilt.
+    ASSERT_EQ(1U, mapped.redWinStates.size());
+    EXPECT_TRUE(NULL != mapped.redWinStates.front().mappedTouchingBegin);
+    EXPECT_EQ(mapped.redWinStates.front().Size(),
+              mapped.redWinStates.front().PackedSize());
+    // The win states of a game's board are among those of the initial board.
+    {
+      State state;
+      InitState(&state);
+      std::vector<Ply> plys;
+      while (State::Phase_Adding == state.phase)
+      {
+        plys.clear();
+        PossiblePlys(state, &plys);
+        if (plys.empty())
+        {
+          InitState(&state);
+          continue;
+        }
+        DoPly(plys[RandBound(static_cast<int>(plys.size()))], &state);
+      }
+      generated.Update(state, NumLayers, NumLayers + 1);
+      typedef BoardEvaluationReachableWinStates::WinStateList WinStateList;
+      const WinStateList& initialList = mapped.blueWinStates;
+      const WinStateList& liveList = generated.blueWinStates;
+      WinStateList::const_iterator initial = initialList.begin();
+      while ((initial != initialList.end()) &&
+             (NumLayers != initial->numWeights))
+      {
+        ++initial;
+      }
+      WinStateList::const_iterator live = liveList.begin();
+      while ((live != liveList.end()) && (NumLayers != live->numWeights))
+      {
+        ++live;
+      }
+      ASSERT_TRUE((initial != initialList.end()) && (live != liveList.end()));
+      EXPECT_GT(live->Size(), 0U);
+      for (const BoardHashKey* key = live->Begin(); key != live->End(); ++key)
+      {
+        EXPECT_TRUE(initial->Contains(*key));
+      }
+    }
+    BoardEvaluationReachableWinStates::IncrementalCounts counts;
+    enum { NumStates = 32, };
+    for (int stateIdx = 0; stateIdx < NumStates; ++stateIdx)
+    {
+      State state;
+      RandomRemovingPhase(&state);
+      EXPECT_EQ(mapped.Score(state.board),
+                mapped.ScoreIncremental(state.board, &counts));
+      generated.Update(state, 3, 5);
+      mapped.Update(state, 3, 5);
+      EXPECT_EQ(generated.Score(state.board), mapped.Score(state.board));
+    }
+  }
+  // A truncated file must be rejected.
+  {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file << "NTGWINST";
+  }
+  {
+    WinStateTable table;
+    EXPECT_FALSE(table.Load(filename));
+    EXPECT_FALSE(table.IsLoaded());
+  }
+  // Keys out of order or a touching index out of range must be rejected.
+  {
+    typedef BoardEvaluationReachableWinStates::NumWeightsWinStates
+      NumWeightsWinStates;
+    const unsigned long long keys[] = { 1ULL, 2ULL, };
+    const unsigned long long filter[] = { 0ULL, };
+    const PackedSubBoard packedStates[2];
+    std::vector<unsigned int> touchingBegin(NumWeightsWinStates::TouchingSlots + 1,
+                                            0U);
+    WinStateTable::Layer layer;
+    layer.numWeights = 1;
+    layer.filterShift = 58;
+    layer.states = keys;
+    layer.stateCount = 2;
+    layer.filter = filter;
+    layer.filterWords = 1;
+    layer.packedStates =
+      reinterpret_cast<const unsigned long long*>(packedStates);
+    layer.touchingBegin = &touchingBegin[0];
+    layer.touching = NULL;
+    layer.touchingCount = 0;
+    WinStateTable::LayerList layers(1, layer);
+    ASSERT_TRUE(WinStateTable::Write(filename, layers));
+    WinStateTable sorted;
+    EXPECT_TRUE(sorted.Load(filename));
+    const unsigned long long unsortedKeys[] = { 2ULL, 1ULL, };
+    layers.front().states = unsortedKeys;
+    ASSERT_TRUE(WinStateTable::Write(filename, layers));
+    WinStateTable unsorted;
+    EXPECT_FALSE(unsorted.Load(filename));
+    EXPECT_FALSE(unsorted.IsLoaded());
+    layers.front().states = keys;
+    const unsigned int touching[] = { 2U, };
+    touchingBegin.back() = 1U;
+    layers.front().touching = touching;
+    layers.front().touchingCount = 1;
+    ASSERT_TRUE(WinStateTable::Write(filename, layers));
+    WinStateTable outOfRange;
+    EXPECT_FALSE(outOfRange.Load(filename));
+    touchingBegin.assign(touchingBegin.size(), 1U);
+    touchingBegin.front() = 0U;
+    const unsigned int inRange[] = { 1U, };
+    layers.front().touching = inRange;
+    ASSERT_TRUE(WinStateTable::Write(filename, layers));
+    WinStateTable indexed;
+    EXPECT_TRUE(indexed.Load(filename));
+  }
+  remove(filename);
+}
+
+TEST(opening_book, WriteAndFind)
+{
+  // Every state a side faces within the book plys must have a legal ply.
+  const char* filename = "ntg_gtest_book.bin";
+  enum { Plys = 3, };
+  enum { Depth = 2, };
+  ASSERT_TRUE(WriteStandardOpeningBook(filename, Plys, Depth, NULL));
+  {
+    OpeningBook book;
+    ASSERT_TRUE(book.Load(filename));
+    EXPECT_EQ(static_cast<int>(Depth), book.GetDepth());
+    EXPECT_GT(book.GetEntryCount(), 0U);
+    State state;
+    InitState(&state);
+    Ply redPly;
+    ASSERT_TRUE(book.Find(state, &redPly));
+    {
+      AlphaBetaPruningPlayer player(State::Turn_Red, NULL, &book);
+      Ply ply;
+      player.NextPly(&state, &ply);
+      EXPECT_EQ(redPly.pos, ply.pos);
+      EXPECT_EQ(redPly.wIdx, ply.wIdx);
+    }
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    for (std::vector<Ply>::const_iterator ply = plys.begin();
+         ply != plys.end();
+         ++ply)
+    {
+      // Blue faces every red ply, red only faces its book ply.
+      DoPly(*ply, &state);
+      Ply bluePly;
+      EXPECT_TRUE(book.Find(state, &bluePly));
+      UndoPly(*ply, &state);
+    }
+    DoPly(redPly, &state);
+    plys.clear();
+    PossiblePlys(state, &plys);
+    ASSERT_FALSE(plys.empty());
+    for (std::vector<Ply>::const_iterator ply = plys.begin();
+         ply != plys.end();
+         ++ply)
+    {
+      DoPly(*ply, &state);
+      Ply bookPly;
+      ASSERT_TRUE(book.Find(state, &bookPly));
+      std::vector<Ply> legalPlys;
+      PossiblePlys(state, &legalPlys);
+      bool legal = false;
+      for (std::vector<Ply>::const_iterator legalPly = legalPlys.begin();
+           legalPly != legalPlys.end();
+           ++legalPly)
+      {
+        legal = legal || ((legalPly->pos == bookPly.pos) &&
+                          (legalPly->wIdx == bookPly.wIdx));
+      }
+      EXPECT_TRUE(legal);
+      // States past the book plys are searched.
+      DoPly(bookPly, &state);
+      Ply pastPly;
+      EXPECT_FALSE(book.Find(state, &pastPly));
+      UndoPly(bookPly, &state);
+      UndoPly(*ply, &state);
+    }
+    // Keys tell hands apart on equal boards.
+    State lhs;
+    InitState(&lhs);
+    State rhs = lhs;
+    rhs.red.hand[0] = Player::Played;
+    EXPECT_NE(OpeningBook::Key(lhs), OpeningBook::Key(rhs));
+    RandomRemovingPhase(&state);
+    Ply ply;
+    EXPECT_FALSE(book.Find(state, &ply));
+  }
+  // A truncated file must be rejected.
+  {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    file << "NTGBOOKS";
+  }
+  {
+    OpeningBook book;
+    EXPECT_FALSE(book.Load(filename));
+    EXPECT_FALSE(book.IsLoaded());
+  }
+  remove(filename);
+}
+
+TEST(depth_controller, ChooseAndRecord)
+{
+  State state;
+  InitState(&state);
+  DepthController control;
+  EXPECT_EQ(static_cast<int>(State::MaxPlys),
+            DepthController::PlysLeft(state));
+  // The caller's depth is kept until the phase is measured.
+  EXPECT_EQ(4, control.Choose(state, 4));
+  // 100000 nodes per second.
+  control.Record(state, 4, 10000ULL, 0.1);
+  EXPECT_NEAR(100000.0, control.nodeRates[State::Phase_Adding], 1e-6);
+  EXPECT_NEAR(0.1, control.PredictTime(state, 4), 1e-9);
+  // Depths grow with the minimal tree.
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  const int numPlys = static_cast<int>(plys.size());
+  EXPECT_NEAR(0.1 * (DepthController::MinimalTreeNodes(numPlys, 5) /
+                     DepthController::MinimalTreeNodes(numPlys, 4)),
+              control.PredictTime(state, 5), 1e-9);
+  control.maxTime = 1.001 * control.PredictTime(state, 5);
+  EXPECT_EQ(5, control.Choose(state, 4));
+  control.maxTime = 0.6 * control.PredictTime(state, 4);
+  EXPECT_EQ(3, control.Choose(state, 4));
+  control.maxTime = 0.0;
+  EXPECT_EQ(static_cast<int>(DepthController::MinDepth),
+            control.Choose(state, 4));
+  // Cheap searches deepen the next one by at most the step.
+  control.maxTime = 1.0;
+  control.Record(state, 4, 16ULL, 0.1);
+  EXPECT_EQ(4 + DepthController::MaxDepthStep, control.Choose(state, 4));
+  // Phases are measured apart and depths stop at the end of the game.
+  RandomRemovingPhase(&state);
+  EXPECT_EQ(9, control.Choose(state, 9));
+  control.Record(state, State::MaxPlys, 16ULL, 0.1);
+  EXPECT_EQ(std::max(static_cast<int>(DepthController::MinDepth),
+                     DepthController::PlysLeft(state)),
+            control.Choose(state, 9));
+  // The search counts the nodes it visits.
+  {
+    InitState(&state);
+    AlphaBetaPruning::Params params;
+    params.maxDepthAdding = 2;
+    BoardEvaluationReachableWinStates evalFunc(State::Turn_Red);
+    Ply ply;
+    AlphaBetaPruning::Run(&params, &state, &evalFunc, &ply);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    EXPECT_EQ(1ULL + plys.size(), params.nodes);
+  }
+}
+
+TEST(time_manager, Allocate)
+{
+  State state;
+  InitState(&state);
+  std::vector<Ply> plys;
+  PossiblePlys(state, &plys);
+  const int numPlys = static_cast<int>(plys.size());
+  TimeManager timeManager;
+  const TimeManager::Deadlines first = timeManager.Allocate(state, numPlys);
+  EXPECT_GT(first.soft, 0.0);
+  EXPECT_GE(first.hard, first.soft);
+  EXPECT_LE(first.hard, timeManager.maxShare * timeManager.Remaining());
+  // Forced moves get no search time.
+  const TimeManager::Deadlines forced = timeManager.Allocate(state, 1);
+  EXPECT_EQ(0.0, forced.soft);
+  EXPECT_EQ(timeManager.minHardTime, forced.hard);
+  // Wider positions get more time and less remaining time gives less.
+  EXPECT_GT(timeManager.Allocate(state, 2 * numPlys).soft, first.soft);
+  timeManager.Spend(0.5 * timeManager.Remaining());
+  EXPECT_LT(timeManager.Allocate(state, numPlys).soft, first.soft);
+  timeManager.Spend(timeManager.budget);
+  EXPECT_EQ(0.0, timeManager.Remaining());
+  EXPECT_EQ(timeManager.minHardTime,
+            timeManager.Allocate(state, numPlys).hard);
+  timeManager.StartGame();
+  EXPECT_NEAR(first.soft, timeManager.Allocate(state, numPlys).soft, 1e-9);
+  // The search stops at the hard deadline.
+  {
+    AlphaBetaPruning::Params params;
+    params.maxDepthAdding = 8;
+    params.maxTime = 0.05;
+    BoardEvaluationReachableWinStates evalFunc(State::Turn_Red);
+    Ply ply;
+    const Timer timer;
+    AlphaBetaPruning::Run(&params, &state, &evalFunc, &ply);
+    EXPECT_TRUE(params.aborted);
+    EXPECT_LT(timer.GetTime(), 1.0);
+  }
+}
+
+TEST(time_manager, PlayerDeadlines)
+{
+  // A search that cannot finish still plays a legal ply in time.
+  {
+    State state;
+    InitState(&state);
+    AlphaBetaPruningPlayer player(State::Turn_Red);
+    player.ApplyDepthHeuristics(state);
+    player.SetDeadlines(0.0, 1e-6);
+    const Timer timer;
+    player.params.maxDepthAdding = 6;
+    Ply ply;
+    player.SearchWithDeadline(&state, &player.params.maxDepthAdding, &ply);
+    EXPECT_LT(timer.GetTime(), 1.0);
+    EXPECT_TRUE(player.params.aborted);
+    std::vector<Ply> plys;
+    PossiblePlys(state, &plys);
+    bool possible = false;
+    for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+    {
+      possible = possible ||
+                 ((plys[plyIdx].pos == ply.pos) &&
+                  (plys[plyIdx].wIdx == ply.wIdx));
+    }
+    EXPECT_TRUE(possible);
+  }
+  // A forced ply is played without searching.
+  {
+    enum { MaxGames = 64, };
+    std::vector<Ply> plys;
+    State state;
+    bool forced = false;
+    for (int game = 0; !forced && (game < MaxGames); ++game)
+    {
+      RandomRemovingPhase(&state);
+      for (;;)
+      {
+        plys.clear();
+        PossiblePlys(state, &plys);
+        if (plys.size() <= 1)
+        {
+          break;
+        }
+        DoPly(plys.front(), &state);
+      }
+      forced = (1 == plys.size());
+    }
+    ASSERT_TRUE(forced);
+    AlphaBetaPruningPlayer player(state.turn);
+    Ply ply;
+    player.NextPly(&state, &ply);
+    EXPECT_EQ(plys.front().pos, ply.pos);
+    EXPECT_EQ(0ULL, player.params.nodes);
+  }
+}
+
+TEST(mcts, SearchAndReuse)
+{
+  enum { NumGames = 8, };
+  enum { Playouts = 2000, };
+  for (int game = 0; game < NumGames; ++game)
+  {
+    State state;
+    RandomRemovingPhase(&state);
+    MonteCarloTreeSearch::Params params;
+    params.maxPlayouts = Playouts;
+    params.maxTime = 60.0;
+    params.batchPlayouts = (1 == (game & 1));
+    std::vector<Ply> plys;
+    for (;;)
+    {
+      plys.clear();
+      PossiblePlys(state, &plys);
+      if (plys.empty())
+      {
+        break;
+      }
+      Ply ply;
+      MonteCarloTreeSearch::Run(&params, &state, &ply);
+      EXPECT_EQ(static_cast<int>(Playouts), params.playouts);
+      // The ply is one of the non suicidal plys.
+      bool found = false;
+      for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+      {
+        found |= (plys[plyIdx].pos == ply.pos) &&
+                 (plys[plyIdx].wIdx == ply.wIdx);
+      }
+      EXPECT_TRUE(found);
+      // The arena holds a consistent tree.
+      const MonteCarloTreeSearch::NodeList& nodes = params.nodes;
+      EXPECT_EQ(params.reusedVisits + Playouts, nodes[0].visits);
+      for (size_t nodeIdx = 0; nodeIdx < nodes.size(); ++nodeIdx)
+      {
+        const MonteCarloTreeSearch::Node& node = nodes[nodeIdx];
+        int childVisits = 0;
+        for (int childIdx = node.firstChild;
+             childIdx < (node.firstChild + node.numChildren);
+             ++childIdx)
+        {
+          ASSERT_GT(childIdx, static_cast<int>(nodeIdx));
+          childVisits += nodes[childIdx].visits;
+        }
+        EXPECT_LE(childVisits, node.visits);
+        EXPECT_LE(node.wins, node.visits);
+      }
+      // Our ply and a random reply leave the search a subtree.
+      DoPly(ply, &state);
+      plys.clear();
+      PossiblePlys(state, &plys);
+      if (plys.empty())
+      {
+        break;
+      }
+      DoPly(plys[RandBound(plys.size())], &state);
+      EXPECT_TRUE(MonteCarloTreeSearch::FindRoot(state, &params));
+      EXPECT_TRUE(MonteCarloTreeSearch::SameState(state, params.rootState));
+    }
+  }
+}
+
+TEST(playout, PlayoutBoard)
+{
+  // Random plys are drawn from exactly the non suicidal plys and the board
+  // follows the state through whole games.
+  enum { NumGames = 64, };
+  enum { DrawsPerPly = 40, };
+  RandomEngine rng(11);
+  std::vector<Ply> plys;
+  for (int game = 0; game < NumGames; ++game)
+  {
+    State state;
+    if (game & 1)
+    {
+      RandomRemovingPhase(&state);
+    }
+    else
+    {
+      InitState(&state);
+    }
+    PlayoutBoard board;
+    board.Load(state);
+    for (;;)
+    {
+      int torqueL;
+      int torqueR;
+      Torques(state.board, &torqueL, &torqueR);
+      ASSERT_EQ(torqueL, board.torqueL);
+      ASSERT_EQ(torqueR, board.torqueR);
+      ASSERT_EQ(state.turn, board.turn);
+      ASSERT_EQ(state.phase, board.phase);
+      plys.clear();
+      PossiblePlys(state, &plys);
+      Ply ply;
+      if (plys.empty())
+      {
+        EXPECT_FALSE(board.RandomPly(&rng, &ply));
+        break;
+      }
+      std::vector<int> hits(plys.size(), 0);
+      const int draws = DrawsPerPly * static_cast<int>(plys.size());
+      for (int draw = 0; draw < draws; ++draw)
+      {
+        ASSERT_TRUE(board.RandomPly(&rng, &ply));
+        int found = -1;
+        for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+        {
+          if ((plys[plyIdx].pos == ply.pos) && (plys[plyIdx].wIdx == ply.wIdx))
+          {
+            found = static_cast<int>(plyIdx);
+          }
+        }
+        ASSERT_GE(found, 0);
+        ++hits[found];
+      }
+      EXPECT_EQ(hits.end(), std::find(hits.begin(), hits.end(), 0));
+      board.DoPly(ply);
+      DoPly(ply, &state);
+    }
+  }
+}
+
+TEST(playout, PlayoutBatch)
+{
+  // Division by reciprocal is exact for every torque a board may have.
+  for (Weight w = 1; w <= PlayoutBatch::MaxWeight; ++w)
+  {
+    const unsigned int recip = PlayoutBatch::Reciprocal(w);
+    for (int t = 0; t < PlayoutBatch::MaxTorque; ++t)
+    {
+      ASSERT_EQ(t / w, PlayoutBatch::Divide(t, recip));
+    }
+  }
+  // First plys are legal and a lost position is lost in every lane.
+  RandomEngine rng(13);
+  std::vector<Ply> plys;
+  PlayoutBatch batch;
+  for (int game = 0; game < 64; ++game)
+  {
+    State state;
+    RandomRemovingPhase(&state);
+    for (int ply = RandBound(&rng, State::NumRemoved); ply > 0; --ply)
+    {
+      plys.clear();
+      PossiblePlys(state, &plys);
+      if (plys.empty())
+      {
+        break;
+      }
+      DoPly(plys[RandBound(&rng, static_cast<int>(plys.size()))], &state);
+    }
+    plys.clear();
+    PossiblePlys(state, &plys);
+    PlayoutBoard board;
+    board.Load(state);
+    batch.Load(board);
+    batch.Run(&rng);
+    State::Turn loser = state.turn;
+    for (int lane = 0; lane < PlayoutBatch::Lanes; ++lane)
+    {
+      if (plys.empty())
+      {
+        EXPECT_NE(loser, batch.winners[lane]);
+        continue;
+      }
+      const Ply& first = batch.firstPlys[lane];
+      bool found = false;
+      for (size_t plyIdx = 0; plyIdx < plys.size(); ++plyIdx)
+      {
+        found |= (plys[plyIdx].pos == first.pos) &&
+                 (plys[plyIdx].wIdx == first.wIdx);
+      }
+      EXPECT_TRUE(found);
+    }
+  }
+  // Lockstep games are won as often as single games.
+  {
+    enum { Batches = 1000, };
+    enum { Games = Batches * PlayoutBatch::Lanes, };
+    State state;
+    InitState(&state);
+    PlayoutBoard root;
+    root.Load(state);
+    int batchRedWins = 0;
+    int boardRedWins = 0;
+    for (int batchIdx = 0; batchIdx < Batches; ++batchIdx)
+    {
+      batch.Load(root);
+      batch.Run(&rng);
+      for (int lane = 0; lane < PlayoutBatch::Lanes; ++lane)
+      {
+        batchRedWins += (State::Turn_Red == batch.winners[lane]);
+        PlayoutBoard board = root;
+        boardRedWins += (State::Turn_Red == board.Run(&rng));
+      }
+    }
+    // Five standard deviations of the difference of the two counts.
+    const double p = static_cast<double>(boardRedWins) / Games;
+    EXPECT_NEAR(boardRedWins, batchRedWins,
+                5.0 * std::sqrt(2.0 * Games * p * (1.0 - p)) + 1.0);
+  }
+}
 
 }
 
@@ -1,6 +1,7 @@
 #ifndef _NO_TIPPING_GAME_NTG_GTEST_UTILS_H_
 #define _NO_TIPPING_GAME_NTG_GTEST_UTILS_H_
 #include "ntg.h"
+#include "rand_bound.h"
 #include <vector>
 #include <algorithm>
 
@@ -17,7 +18,7 @@ struct RandomPlayOrderGenerator
   }
   std::vector<int> operator()() const
   {
-    std::random_shuffle(seq.begin(), seq.end());
+    hps::RandomShuffle(seq.begin(), seq.end());
     return seq;
   }
   mutable std::vector<int> seq;
@@ -71,7 +72,7 @@ void RandomRemovingPhase(hps::State* state)
   // Find stable ordering.
   do
   {
-    std::random_shuffle(board.begin(), board.end());
+    RandomShuffle(board.begin(), board.end());
   } while (Tipped(board));
   // Switch phase.
   state->phase = State::Phase_Removing;
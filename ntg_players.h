@@ -1,10 +1,18 @@
 #ifndef _NO_TIPPING_GAME_NTG_PLAYERS_H_
 #define _NO_TIPPING_GAME_NTG_PLAYERS_H_
 #include "alphabetapruning.h"
+#include "depth_controller.h"
 #include "minimax.h"
+#include "mcts.h"
+#include "playout.h"
 #include "adversarial_utils.h"
 #include "ntg.h"
+#include "opening_book.h"
 #include "rand_bound.h"
+#include "timer.h"
+#include <cstring>
+#include <limits>
+#include <omp.h>
 
 namespace hps
 {
@@ -13,7 +21,13 @@ namespace ntg
 
 struct RandomPlayer
 {
-  RandomPlayer(const State::Turn) : plys() {}
+  /// <summary> The engine is seeded from the default engine so that games
+  ///   differ when the default engine is seeded.
+  /// </summary>
+  RandomPlayer(const State::Turn)
+    : plys(),
+      rng(DefaultRandomEngine()())
+  {}
 
   /// <summary> Return next ply without mutating the state. </summary>
   void NextPly(State* state, Ply* ply)
@@ -29,7 +43,7 @@ struct RandomPlayer
     const size_t plyCount = plys.size();
     if (plyCount > 0)
     {
-      int randPly = RandBound(plyCount);
+      int randPly = RandBound(&rng, static_cast<int>(plyCount));
       *ply = plys[randPly];
     }
     // We lose.
@@ -40,6 +54,7 @@ struct RandomPlayer
   }
 
   std::vector<Ply> plys;
+  RandomEngine rng;
 };
 
 struct MinimaxPlayer
@@ -102,7 +117,8 @@ struct MinimaxPlayer
   MinimaxPlayer(const State::Turn who_)
     : who(who_),
       params(),
-      evalFunc(who)
+      evalFunc(who),
+      depthControl()
   {
 #if NDEBUG
     params.maxDepthAdding = 4;
@@ -134,9 +150,15 @@ struct MinimaxPlayer
                         abs(state->red.remain + state->blue.remain);
       MinimaxDepthHeuristics::Apply(turns + 1, *state, this);
     }
+    // Fit the depth to the time allowance once the phase is measured.
+    int& maxDepth = (State::Phase_Adding == state->phase) ?
+                    params.maxDepthAdding : params.maxDepthRemoving;
+    maxDepth = depthControl.Choose(*state, maxDepth);
 
     // Get the minimax move.
+    Timer timer;
     Minimax::Run(&params, state, &evalFunc, ply);
+    depthControl.Record(*state, maxDepth, params.nodes, timer.GetTime());
     assert(ply->pos >= -Board::Size);
     assert(ply->pos <= Board::Size);
   }
@@ -144,6 +166,7 @@ struct MinimaxPlayer
   State::Turn who;
   Minimax::Params params;
   BoardEvaluationReachableWinStates evalFunc;
+  DepthController depthControl;
 };
 
 struct AlphaBetaPruningPlayer
@@ -214,10 +237,19 @@ struct AlphaBetaPruningPlayer
     }
   };
 
-  AlphaBetaPruningPlayer(const State::Turn who_)
+  /// <summary> Create a player, using the prebuilt win states in the
+  ///   table and the plys in the book when they are loaded.
+  /// </summary>
+  explicit AlphaBetaPruningPlayer(const State::Turn who_,
+                                  const WinStateTable* table_ = NULL,
+                                  const OpeningBook* book_ = NULL)
     : who(who_),
       params(),
-      evalFunc(who)
+      evalFunc(who, table_),
+      table(table_),
+      book(book_),
+      depthControl(),
+      plys()
   {
 #if NDEBUG
     params.maxDepthAdding = 4;
@@ -236,42 +268,267 @@ struct AlphaBetaPruningPlayer
     assert(ply);
     assert(!Tipped(state->board));
 
-    // Optimize parameters.
-    if (State::Phase_Adding == state->phase)
+    // Play from the book without searching.
+    if ((NULL != book) && book->Find(*state, ply))
     {
-      const int turns = State::NumAdded -
-                        (state->red.remain + state->blue.remain);
-      AlphaBetaPruningDepthHeuristics::Apply(turns + 1, *state, this);
+      return;
     }
-    else
+    // Optimize parameters.
+    ApplyDepthHeuristics(*state);
+    // A forced ply needs no search.
+    plys.clear();
+    PossiblePlys(*state, &plys);
+    if (1 == plys.size())
     {
-      const int turns = State::NumAdded +
-                        abs(state->red.remain + state->blue.remain);
-      AlphaBetaPruningDepthHeuristics::Apply(turns + 1, *state, this);
+      *ply = plys.front();
+      return;
     }
+    // Fit the depth to the time allowance once the phase is measured.
+    int& maxDepth = (State::Phase_Adding == state->phase) ?
+                    params.maxDepthAdding : params.maxDepthRemoving;
+    maxDepth = depthControl.Choose(*state, maxDepth);
 
     // Get the minimax move.
-    AlphaBetaPruning::Run(&params, state, &evalFunc, ply);
+    if (params.maxTime > 0.0)
+    {
+      SearchWithDeadline(state, &maxDepth, ply);
+    }
+    else
+    {
+      Timer timer;
+      AlphaBetaPruning::Run(&params, state, &evalFunc, ply);
+      depthControl.Record(*state, maxDepth, params.nodes, timer.GetTime());
+    }
     assert(ply->pos >= -Board::Size);
     assert(ply->pos <= Board::Size);
   }
 
+  /// <summary> Drop what was learned from the positions of the last game. </summary>
+  /// <remarks>
+  ///   <para> The win states go back to the initial layers and the depth
+  ///     estimates are forgotten. The measured node rates are kept.
+  ///   </para>
+  /// </remarks>
+  void StartGame()
+  {
+    evalFunc.ResetWinStates(table);
+    depthControl.ForgetEstimates();
+  }
+
+  /// <summary> Set the time limits of the next moves in seconds. </summary>
+  /// <remarks>
+  ///   <para> The depth is chosen to finish by the soft limit. A search still
+  ///     running at the hard limit is aborted, and a hard limit that is not
+  ///     positive removes it.
+  ///   </para>
+  /// </remarks>
+  void SetDeadlines(const double softTime, const double hardTime)
+  {
+    depthControl.maxTime = softTime;
+    params.maxTime = hardTime;
+  }
+
+  /// <summary> Search to the depth within the hard limit. </summary>
+  /// <remarks>
+  ///   <para> One depth less is searched first so that an aborted search
+  ///     still leaves a ply, and the full depth is skipped when it is
+  ///     predicted to overrun. When even the shallower search is aborted,
+  ///     the hard limit has passed, so the ply that scores best without
+  ///     searching is played instead.
+  ///   </para>
+  /// </remarks>
+  void SearchWithDeadline(State* state, int* maxDepth, Ply* ply)
+  {
+    assert(state && maxDepth && ply);
+    const double hardTime = params.maxTime;
+    // Depths past the end of the game search the same tree.
+    const int targetDepth =
+      std::min(*maxDepth, std::max(static_cast<int>(DepthController::MinDepth),
+                                   DepthController::PlysLeft(*state)));
+    Timer timer;
+    bool found = false;
+    for (int depth = std::max(static_cast<int>(DepthController::MinDepth),
+                              targetDepth - 1);
+         depth <= targetDepth;
+         ++depth)
+    {
+      const double timeLeft = hardTime - timer.GetTime();
+      if (found &&
+          ((timeLeft <= 0.0) ||
+           (depthControl.PredictTime(*state, depth) > timeLeft)))
+      {
+        break;
+      }
+      *maxDepth = depth;
+      params.maxTime = timeLeft;
+      Timer searchTimer;
+      Ply searchPly;
+      AlphaBetaPruning::Run(&params, state, &evalFunc, &searchPly);
+      if (params.aborted)
+      {
+        // The next move must not predict this depth to be as cheap.
+        depthControl.Record(*state, depth, params.nodes,
+                            searchTimer.GetTime());
+        break;
+      }
+      depthControl.Record(*state, depth, params.nodes, searchTimer.GetTime());
+      *ply = searchPly;
+      found = true;
+    }
+    if (!found)
+    {
+      BestEvaluatedPly(state, ply);
+    }
+    params.maxTime = hardTime;
+  }
+
+  /// <summary> Get the ply to the state that scores best. </summary>
+  void BestEvaluatedPly(State* state, Ply* ply)
+  {
+    assert(state && ply);
+    plys.clear();
+    PossiblePlys(*state, &plys);
+    // We lose.
+    if (plys.empty())
+    {
+      AnyPlyWillDo(state, ply);
+      return;
+    }
+    int bestScore = std::numeric_limits<int>::min();
+    for (std::vector<Ply>::const_iterator testPly = plys.begin();
+         testPly != plys.end();
+         ++testPly)
+    {
+      DoPly(*testPly, state);
+      const int score = evalFunc(*state);
+      if ((testPly == plys.begin()) || (score > bestScore))
+      {
+        bestScore = score;
+        *ply = *testPly;
+      }
+      UndoPly(*testPly, state);
+    }
+  }
+
+  /// <summary> Set the search depths and win states for the state. </summary>
+  void ApplyDepthHeuristics(const State& state)
+  {
+    if (State::Phase_Adding == state.phase)
+    {
+      const int turns = State::NumAdded -
+                        (state.red.remain + state.blue.remain);
+      AlphaBetaPruningDepthHeuristics::Apply(turns + 1, state, this);
+    }
+    else
+    {
+      const int turns = State::NumAdded +
+                        abs(state.red.remain + state.blue.remain);
+      AlphaBetaPruningDepthHeuristics::Apply(turns + 1, state, this);
+    }
+  }
+
   State::Turn who;
   AlphaBetaPruning::Params params;
   BoardEvaluationReachableWinStates evalFunc;
+  const WinStateTable* table;
+  const OpeningBook* book;
+  DepthController depthControl;
+  std::vector<Ply> plys;
 };
 
+/// <summary> Plays the first ply with the best win rate in random games. </summary>
+/// <remarks>
+///   <para> Trials run on every OpenMP thread until the time budget is used.
+///     Each thread has its own generator, playout board and first ply tally,
+///     and the tallies are merged after the threads join. With batchPlayouts
+///     the trials are played in lockstep batches.
+///   </para>
+/// </remarks>
 struct MonteCarloPlayer
 {
-  struct PlyLtOp
+  /// <summary> Wins and visits of each first ply in flat arrays. </summary>
+  /// <remarks>
+  ///   <para> Entries are indexed by (position, weight index). Removing plys
+  ///     have no weight index and use the first weight slot.
+  ///   </para>
+  /// </remarks>
+  struct PlyTally
   {
-    inline bool operator()(const Ply& lhs, const Ply& rhs) const
+    enum { Size = Board::Positions * Player::NumWeights, };
+
+    PlyTally()
+    {
+      Clear();
+    }
+
+    static inline int Index(const Ply& ply)
+    {
+      assert(ply.pos >= -Board::Size);
+      assert(ply.pos <= Board::Size);
+      assert(ply.wIdx < Player::NumWeights);
+      const int wIdx = (ply.wIdx >= 0) ? ply.wIdx : 0;
+      return ((ply.pos + Board::Size) * Player::NumWeights) + wIdx;
+    }
+
+    inline void Clear()
     {
-      return (lhs.pos < rhs.pos) && (lhs.wIdx < rhs.wIdx);
+      memset(wins, 0, sizeof(wins));
+      memset(visits, 0, sizeof(visits));
     }
+
+    inline void Record(const Ply& ply, const bool won)
+    {
+      const int plyIdx = Index(ply);
+      wins[plyIdx] += won;
+      ++visits[plyIdx];
+    }
+
+    inline void Add(const PlyTally& tally)
+    {
+      for (int plyIdx = 0; plyIdx < Size; ++plyIdx)
+      {
+        wins[plyIdx] += tally.wins[plyIdx];
+        visits[plyIdx] += tally.visits[plyIdx];
+      }
+    }
+
+    int wins[Size];
+    int visits[Size];
+  };
+
+  /// <summary> Trial data owned by one thread. </summary>
+  struct ThreadTrials
+  {
+    ThreadTrials()
+      : rng(),
+        trials(0),
+        board(),
+        batch(),
+        tally()
+    {}
+
+    RandomEngine rng;
+    int trials;
+    PlayoutBoard board;
+    PlayoutBatch batch;
+    PlyTally tally;
   };
+  typedef std::vector<ThreadTrials> ThreadTrialsList;
 
-  MonteCarloPlayer(const State::Turn who_) : who(who_), plyCountMap() {}
+  enum { TrialsPerTimeCheck = 32, };
+  enum { Seed = 0x4d435031, };
+
+  MonteCarloPlayer(const State::Turn who_)
+    : who(who_),
+      maxTime(1.0),
+      batchPlayouts(HPS_NTG_BATCH_PLAYOUTS != 0),
+      rng(Seed ^ who_),
+      trials(0),
+      threadTrials(),
+      tally(),
+      plys(),
+      rootBoard()
+  {}
 
   /// <summary> Return next ply without mutating the state. </summary>
   void NextPly(const State* state, Ply* ply)
@@ -280,59 +537,164 @@ struct MonteCarloPlayer
     assert(ply);
     assert(!Tipped(state->board));
 
-    // Simulate.
-    plyCountMap.clear();
-    for (int trial = 0; trial < 1000; ++trial)
+    tally.Clear();
+    trials = 0;
+    plys.clear();
+    PossiblePlys(*state, &plys);
+    // We lose.
+    if (plys.empty())
     {
-      State modifyState = *state;
-      // Players.
-      RandomPlayer me(who);
-      State::Turn other = who;
-      NextTurn(&other);
-      RandomPlayer you(other);
-      // Get first ply.
-      Ply firstPly;
-      {
-        me.NextPly(&modifyState, &firstPly);
-      }
-      *ply = firstPly;
-      DoPly(*ply, &modifyState);
-      while (!Tipped(modifyState.board))
+      State loseState = *state;
+      AnyPlyWillDo(&loseState, ply);
+      return;
+    }
+    rootBoard.Load(*state);
+    // Seed the threads.
+    threadTrials.resize(omp_get_max_threads());
+    for (ThreadTrialsList::iterator threadData = threadTrials.begin();
+         threadData != threadTrials.end();
+         ++threadData)
+    {
+      threadData->rng.Seed(rng());
+      threadData->trials = 0;
+      threadData->tally.Clear();
+    }
+    // Simulate until the time is up.
+    const Timer timer;
+#pragma omp parallel
+    {
+      ThreadTrials& threadData = threadTrials[omp_get_thread_num()];
+      do
       {
-        if (who == modifyState.turn)
+        if (batchPlayouts)
         {
-          me.NextPly(&modifyState, ply);
+          for (int trial = 0;
+               trial < TrialsPerTimeCheck;
+               trial += PlayoutBatch::Lanes)
+          {
+            BatchTrials(rootBoard, who, &threadData);
+          }
         }
         else
         {
-          you.NextPly(&modifyState, ply);
+          for (int trial = 0; trial < TrialsPerTimeCheck; ++trial)
+          {
+            Trial(rootBoard, who, &threadData);
+          }
         }
-        DoPly(*ply, &modifyState);
-      }
-      // Did I win?
-      if (who == modifyState.turn)
-      {
-        ++plyCountMap[firstPly];
-      }
+        threadData.trials += TrialsPerTimeCheck;
+      } while (timer.GetTime() < maxTime);
+    }
+    // Merge the tallies.
+    for (ThreadTrialsList::const_iterator threadData = threadTrials.begin();
+         threadData != threadTrials.end();
+         ++threadData)
+    {
+      trials += threadData->trials;
+      tally.Add(threadData->tally);
     }
-    // Gather best ply.
-    int maxCount = std::numeric_limits<int>::min();
-    for (PlyCountMap::const_iterator plyCount = plyCountMap.begin();
-         plyCount != plyCountMap.end();
-         ++plyCount)
+    // Gather the ply with the best win rate.
+    double bestRate = -1.0;
+    for (std::vector<Ply>::const_iterator rootPly = plys.begin();
+         rootPly != plys.end();
+         ++rootPly)
     {
-      if (plyCount->second > maxCount)
+      const int plyIdx = PlyTally::Index(*rootPly);
+      if (tally.visits[plyIdx] > 0)
       {
-        maxCount = plyCount->second;
-        *ply = plyCount->first;
+        const double rate = static_cast<double>(tally.wins[plyIdx]) /
+                            tally.visits[plyIdx];
+        if (rate > bestRate)
+        {
+          bestRate = rate;
+          *ply = *rootPly;
+        }
       }
     }
+    assert(bestRate >= 0.0);
+  }
+
+  /// <summary> Play one random game and tally its first ply. </summary>
+  /// <remarks>
+  ///   <para> The root must have a legal ply. </para>
+  /// </remarks>
+  static void Trial(const PlayoutBoard& rootBoard,
+                    const State::Turn who,
+                    ThreadTrials* threadData)
+  {
+    assert(threadData);
+    PlayoutBoard& board = threadData->board;
+    board = rootBoard;
+    Ply firstPly;
+    const bool legal = board.RandomPly(&threadData->rng, &firstPly);
+    assert(legal);
+    (void)legal;
+    board.DoPly(firstPly);
+    // Did I win?
+    const State::Turn winner = board.Run(&threadData->rng);
+    threadData->tally.Record(firstPly, who == winner);
+  }
+
+  /// <summary> Play a batch of random games and tally their first plys. </summary>
+  /// <remarks>
+  ///   <para> The root must have a legal ply. </para>
+  /// </remarks>
+  static void BatchTrials(const PlayoutBoard& rootBoard,
+                          const State::Turn who,
+                          ThreadTrials* threadData)
+  {
+    assert(threadData);
+    PlayoutBatch& batch = threadData->batch;
+    batch.Load(rootBoard);
+    batch.Run(&threadData->rng);
+    // Did I win?
+    for (int lane = 0; lane < PlayoutBatch::Lanes; ++lane)
+    {
+      threadData->tally.Record(batch.firstPlys[lane],
+                               who == batch.winners[lane]);
+    }
   }
 
   State::Turn who;
+  /// <summary> Seconds to simulate per move. </summary>
+  double maxTime;
+  /// <summary> Play trials in lockstep batches. </summary>
+  bool batchPlayouts;
+  RandomEngine rng;
+  /// <summary> Trials run for the last move. </summary>
+  int trials;
+  ThreadTrialsList threadTrials;
+  /// <summary> Merged tally of the last move. </summary>
+  PlyTally tally;
+  std::vector<Ply> plys;
+  PlayoutBoard rootBoard;
+};
 
-  typedef std::map<Ply, int, PlyLtOp> PlyCountMap;
-  PlyCountMap plyCountMap;
+/// <summary> Plays by Monte Carlo tree search and keeps the tree between
+///   moves.
+/// </summary>
+struct MonteCarloTreeSearchPlayer
+{
+  enum { DefaultMaxPlayouts = 20000, };
+
+  MonteCarloTreeSearchPlayer(const State::Turn who_)
+    : who(who_),
+      params()
+  {
+    params.maxPlayouts = DefaultMaxPlayouts;
+  }
+
+  /// <summary> Return next ply without mutating the state. </summary>
+  void NextPly(State* state, Ply* ply)
+  {
+    assert(state);
+    assert(ply);
+    assert(who == state->turn);
+    MonteCarloTreeSearch::Run(&params, state, ply);
+  }
+
+  State::Turn who;
+  MonteCarloTreeSearch::Params params;
 };
 
 }
@@ -0,0 +1,257 @@
+#include "opening_book.h"
+#include "adversarial_utils.h"
+#include "ntg_players.h"
+#include "win_state_table.h"
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+namespace hps
+{
+namespace ntg
+{
+
+namespace detail
+{
+struct OpeningBookHeader
+{
+  char magic[8];
+  unsigned int version;
+  unsigned int depth;
+  unsigned long long entryCount;
+  unsigned long long keyChecksum;
+};
+
+const char OpeningBookMagic[8] = { 'N', 'T', 'G', 'B', 'O', 'O', 'K', 'S' };
+
+typedef char OpeningBookEntrySizeCheck[(sizeof(OpeningBook::Entry) == 16) ? 1 : -1];
+
+inline bool EntryKeyLess(const OpeningBook::Entry& lhs,
+                         const OpeningBook::Entry& rhs)
+{
+  return lhs.key < rhs.key;
+}
+
+/// <summary> Expands the states one side can face and searches each. </summary>
+struct OpeningBookBuilder
+{
+  OpeningBookBuilder(const State::Turn side,
+                     const int plys_,
+                     const int depth_,
+                     const WinStateTable* table)
+    : player(side, table),
+      plys(plys_),
+      depth(depth_),
+      visited(),
+      entries()
+  {}
+
+  void Expand(State* state, const int ply)
+  {
+    assert(state);
+    if ((ply >= plys) || (State::Phase_Adding != state->phase) ||
+        !visited.insert(OpeningBook::Key(*state)).second)
+    {
+      return;
+    }
+    std::vector<Ply> nextPlys;
+    if (player.who == state->turn)
+    {
+      // Search deeper than the live player does.
+      Ply bookPly;
+      player.ApplyDepthHeuristics(*state);
+      player.params.maxDepthAdding = depth;
+      AlphaBetaPruning::Run(&player.params, state, &player.evalFunc, &bookPly);
+      OpeningBook::Entry entry;
+      entry.key = OpeningBook::Key(*state);
+      entry.pos = bookPly.pos;
+      entry.wIdx = bookPly.wIdx;
+      entries.push_back(entry);
+      nextPlys.push_back(bookPly);
+    }
+    else
+    {
+      PossiblePlys(*state, &nextPlys);
+    }
+    for (std::vector<Ply>::const_iterator nextPly = nextPlys.begin();
+         nextPly != nextPlys.end();
+         ++nextPly)
+    {
+      DoPly(*nextPly, state);
+      Expand(state, ply + 1);
+      UndoPly(*nextPly, state);
+    }
+  }
+
+  AlphaBetaPruningPlayer player;
+  int plys;
+  int depth;
+  std::set<unsigned long long> visited;
+  OpeningBook::EntryList entries;
+};
+}
+
+unsigned long long OpeningBook::Key(const State& state)
+{
+  // Fold the hands, turn and phase into one word and mix it into the board
+  // key, so equal boards reached with different hands differ.
+  unsigned long long hands = 0ULL;
+  for (int wIdx = 0; wIdx < Player::NumWeights; ++wIdx)
+  {
+    hands |= static_cast<unsigned long long>(
+               Player::Played == state.red.hand[wIdx]) << wIdx;
+    hands |= static_cast<unsigned long long>(
+               Player::Played == state.blue.hand[wIdx]) <<
+             (Player::NumWeights + wIdx);
+  }
+  hands |= static_cast<unsigned long long>(state.turn) <<
+           (2 * Player::NumWeights);
+  hands |= static_cast<unsigned long long>(state.phase) <<
+           ((2 * Player::NumWeights) + 1);
+  return HashBoard(state.board) ^ detail::SplitMix64(&hands);
+}
+
+bool OpeningBook::Load(const char* filename)
+{
+  using namespace detail;
+  assert(filename);
+
+  m_depth = 0;
+  m_entries = NULL;
+  m_entryCount = 0;
+  if (!m_file.Open(filename))
+  {
+    return false;
+  }
+  const char* data = static_cast<const char*>(m_file.GetData());
+  const size_t fileSize = m_file.GetSize();
+  // Validate header.
+  bool valid = (fileSize >= sizeof(OpeningBookHeader));
+  const OpeningBookHeader* header =
+    reinterpret_cast<const OpeningBookHeader*>(data);
+  if (valid)
+  {
+    const size_t entryBytes = fileSize - sizeof(OpeningBookHeader);
+    valid = (0 == memcmp(header->magic, OpeningBookMagic,
+                         sizeof(OpeningBookMagic))) &&
+            (Version == header->version) &&
+            (PosWeightKeysChecksum() == header->keyChecksum) &&
+            (0 == (entryBytes % sizeof(Entry))) &&
+            (header->entryCount == (entryBytes / sizeof(Entry)));
+  }
+  // Entries must be sorted for the binary search.
+  if (valid)
+  {
+    const Entry* entries = reinterpret_cast<const Entry*>(header + 1);
+    const size_t entryCount = static_cast<size_t>(header->entryCount);
+    for (size_t entryIdx = 1; valid && (entryIdx < entryCount); ++entryIdx)
+    {
+      valid = (entries[entryIdx - 1].key < entries[entryIdx].key);
+    }
+    if (valid)
+    {
+      m_depth = static_cast<int>(header->depth);
+      m_entries = entries;
+      m_entryCount = entryCount;
+    }
+  }
+  if (!valid)
+  {
+    m_file.Close();
+  }
+  return valid;
+}
+
+bool OpeningBook::Write(const char* filename,
+                        const int depth,
+                        EntryList* entries)
+{
+  using namespace detail;
+  assert(filename && entries);
+  assert(depth >= 0);
+
+  std::sort(entries->begin(), entries->end(), EntryKeyLess);
+  OpeningBookHeader header;
+  memcpy(header.magic, OpeningBookMagic, sizeof(OpeningBookMagic));
+  header.version = Version;
+  header.depth = static_cast<unsigned int>(depth);
+  header.entryCount = entries->size();
+  header.keyChecksum = PosWeightKeysChecksum();
+  // Write out.
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.good())
+  {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!entries->empty())
+  {
+    file.write(reinterpret_cast<const char*>(&(*entries)[0]),
+               entries->size() * sizeof(Entry));
+  }
+  return file.good();
+}
+
+bool OpeningBook::Find(const State& state, Ply* ply) const
+{
+  using namespace detail;
+  assert(ply);
+
+  if ((NULL == m_entries) || (State::Phase_Adding != state.phase))
+  {
+    return false;
+  }
+  Entry target;
+  target.key = Key(state);
+  const Entry* entriesEnd = m_entries + m_entryCount;
+  const Entry* entry = std::lower_bound(m_entries, entriesEnd, target,
+                                        EntryKeyLess);
+  if ((entriesEnd == entry) || (entry->key != target.key))
+  {
+    return false;
+  }
+  // Guard against key collisions.
+  if ((entry->pos < -Board::Size) || (entry->pos > Board::Size) ||
+      (entry->wIdx < 0) || (entry->wIdx >= Player::NumWeights) ||
+      (Board::Empty != state.board[entry->pos]) ||
+      (Player::Played == CurrentPlayer(&state)->hand[entry->wIdx]))
+  {
+    return false;
+  }
+  const Ply bookPly(entry->pos, entry->wIdx);
+  State next = state;
+  DoPly(bookPly, &next);
+  if (Tipped(next.board))
+  {
+    return false;
+  }
+  *ply = bookPly;
+  return true;
+}
+
+bool WriteStandardOpeningBook(const char* filename,
+                              const int plys,
+                              const int depth,
+                              const WinStateTable* table)
+{
+  assert(filename);
+  assert(plys >= 0);
+  assert(depth > 0);
+
+  OpeningBook::EntryList entries;
+  const State::Turn sides[] = { State::Turn_Red, State::Turn_Blue, };
+  for (int sideIdx = 0; sideIdx < 2; ++sideIdx)
+  {
+    detail::OpeningBookBuilder builder(sides[sideIdx], plys, depth, table);
+    State state;
+    InitState(&state);
+    builder.Expand(&state, 0);
+    entries.insert(entries.end(),
+                   builder.entries.begin(),
+                   builder.entries.end());
+  }
+  return OpeningBook::Write(filename, depth, &entries);
+}
+
+}
+}
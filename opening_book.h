@@ -0,0 +1,118 @@
+#ifndef _NO_TIPPING_GAME_OPENING_BOOK_H_
+#define _NO_TIPPING_GAME_OPENING_BOOK_H_
+#include "mapped_file.h"
+#include <cstddef>
+#include <vector>
+
+namespace hps
+{
+namespace ntg
+{
+struct State;
+struct Ply;
+class WinStateTable;
+
+/// <summary> Best plys for early adding phase states stored in a versioned
+///   binary file.
+/// </summary>
+/// <remarks>
+///   <para> The file holds a header and then one entry per state sorted by
+///     state key. Entries are searched in place from a read-only mapping of
+///     the file.
+///   </para>
+///   <para> The header carries a checksum of the (position, weight) keys so
+///     that books written with a different key scheme are rejected.
+///   </para>
+/// </remarks>
+class OpeningBook
+{
+public:
+  enum { Version = 1, };
+  /// <summary> States reached within this many plys of the initial state
+  ///   are in the book by default.
+  /// </summary>
+  enum { DefaultPlys = 3, };
+  /// <summary> Adding phase search depth used by default. </summary>
+  enum { DefaultDepth = 6, };
+
+  /// <summary> The best ply for the state with the key. </summary>
+  struct Entry
+  {
+    unsigned long long key;
+    int pos;
+    int wIdx;
+  };
+  typedef std::vector<Entry> EntryList;
+
+  /// <summary> Default file name, relative to the working directory. </summary>
+  static const char* DefaultFilename()
+  {
+    return "ntg_book.bin";
+  }
+
+  /// <summary> Key of a state from its board, hands and turn. </summary>
+  static unsigned long long Key(const State& state);
+
+  OpeningBook() : m_file(), m_depth(0), m_entries(NULL), m_entryCount(0) {}
+
+  /// <summary> Map the file and validate its contents. </summary>
+  bool Load(const char* filename);
+
+  /// <summary> Write the entries searched at the depth to a file sorted
+  ///   by key.
+  /// </summary>
+  static bool Write(const char* filename,
+                    const int depth,
+                    EntryList* entries);
+
+  /// <summary> Get the book ply for the state. </summary>
+  /// <returns> False when the state is not in the book or its ply is not
+  ///   legal in the state.
+  /// </returns>
+  bool Find(const State& state, Ply* ply) const;
+
+  inline bool IsLoaded() const
+  {
+    return m_file.IsOpen();
+  }
+  /// <summary> Adding phase depth the book was searched at. </summary>
+  inline int GetDepth() const
+  {
+    return m_depth;
+  }
+  inline size_t GetEntryCount() const
+  {
+    return m_entryCount;
+  }
+
+private:
+  // Not copyable.
+  OpeningBook(const OpeningBook&);
+  OpeningBook& operator=(const OpeningBook&);
+
+  MappedFile m_file;
+  int m_depth;
+  const Entry* m_entries;
+  size_t m_entryCount;
+};
+
+/// <summary> Search the early adding phase states from the initial state and
+///   write the best plys to a book file.
+/// </summary>
+/// <remarks>
+///   <para> For each side, the states within plys plys of the initial state
+///     are expanded with every opponent ply and with only the book ply of
+///     the side, so the book holds the states the side can actually face.
+///     Each is searched with the adding phase depth set to depth.
+///   </para>
+/// </remarks>
+bool WriteStandardOpeningBook(const char* filename,
+                              const int plys,
+                              const int depth,
+                              const WinStateTable* table);
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_OPENING_BOOK_H_
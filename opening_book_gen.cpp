@@ -0,0 +1,43 @@
+#include "opening_book.h"
+#include "win_state_table.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace hps;
+
+int main(int argc, char** argv)
+{
+  if ((argc < 2) || (argc > 4))
+  {
+    std::cerr << "Usage: " << argv[0] << " <book file> [plys] [depth]"
+              << std::endl;
+    return 1;
+  }
+  const char* filename = argv[1];
+  int plys = OpeningBook::DefaultPlys;
+  if (argc > 2)
+  {
+    plys = atoi(argv[2]);
+  }
+  int depth = OpeningBook::DefaultDepth;
+  if (argc > 3)
+  {
+    depth = atoi(argv[3]);
+  }
+  // Search with prebuilt win states when available.
+  WinStateTable table;
+  table.Load(WinStateTable::DefaultFilename());
+  if (!WriteStandardOpeningBook(filename, plys, depth, &table))
+  {
+    std::cerr << "Failed to write " << filename << "." << std::endl;
+    return 1;
+  }
+  // Check that the book loads.
+  OpeningBook book;
+  if (!book.Load(filename))
+  {
+    std::cerr << "Failed to load " << filename << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}
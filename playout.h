@@ -0,0 +1,575 @@
+#ifndef _NO_TIPPING_GAME_PLAYOUT_H_
+#define _NO_TIPPING_GAME_PLAYOUT_H_
+#include "ntg.h"
+
+/// <summary> Whether players use PlayoutBatch by default. </summary>
+/// <remarks>
+///   <para> Lockstep playouts only pay off when the lane loops compile to
+///     wide vector instructions with per lane shifts.
+///   </para>
+/// </remarks>
+#if !defined(HPS_NTG_BATCH_PLAYOUTS)
+#if defined(__AVX2__)
+#define HPS_NTG_BATCH_PLAYOUTS 1
+#else
+#define HPS_NTG_BATCH_PLAYOUTS 0
+#endif
+#endif
+
+namespace hps
+{
+namespace ntg
+{
+
+namespace detail
+{
+/// <summary> Number of set bits. </summary>
+inline unsigned int PopCount(const unsigned int x)
+{
+#if defined(__GNUC__)
+  return static_cast<unsigned int>(__builtin_popcount(x));
+#else
+  unsigned int count = 0;
+  for (unsigned int bits = x; 0U != bits; bits &= bits - 1U)
+  {
+    ++count;
+  }
+  return count;
+#endif
+}
+
+/// <summary> Index of the set bit with rank k, counting from bit 0. </summary>
+inline unsigned int SelectBit(unsigned int x, unsigned int k)
+{
+  assert(k < PopCount(x));
+  for (; k > 0; --k)
+  {
+    x &= x - 1U;
+  }
+#if defined(__GNUC__)
+  return static_cast<unsigned int>(__builtin_ctz(x));
+#else
+  unsigned int bit = 0;
+  for (; 0U == (x & 1U); x >>= 1)
+  {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+}
+
+/// <summary> A game state reduced to position bitmasks and running torques
+///   for random playouts.
+/// </summary>
+/// <remarks>
+///   <para> Bit (pos + Board::Size) of a mask stands for a board position.
+///     A weight w keeps the board up at the positions in one interval, so
+///     the legal positions for each weight are an interval mask and'ed with
+///     the empty or occupied positions. A ply is drawn uniformly from the
+///     legal plys by rank, and a state with no legal ply ends the game
+///     without scanning the board.
+///   </para>
+///   <para> The legal plys are exactly those of PossiblePlys(), which never
+///     removes a weight from the last position.
+///   </para>
+/// </remarks>
+struct PlayoutBoard
+{
+  typedef unsigned int PositionMask;
+  enum { MaxWeight = Player::NumWeights, };
+
+  PlayoutBoard()
+    : emptyMask(0U),
+      torqueL(0),
+      torqueR(0),
+      turn(State::Turn_Red),
+      phase(State::Phase_Adding)
+  {
+    memset(weights, 0, sizeof(weights));
+    memset(weightMasks, 0, sizeof(weightMasks));
+    memset(handMasks, 0, sizeof(handMasks));
+    memset(hands, 0, sizeof(hands));
+  }
+
+  /// <summary> Take the position from a state. </summary>
+  void Load(const State& state)
+  {
+    emptyMask = 0U;
+    memset(weightMasks, 0, sizeof(weightMasks));
+    for (int posIdx = 0; posIdx < Board::Positions; ++posIdx)
+    {
+      const Weight w = state.board.positions[posIdx];
+      const PositionMask bit = 1U << posIdx;
+      weights[posIdx] = w;
+      if (Board::Empty == w)
+      {
+        emptyMask |= bit;
+      }
+      else
+      {
+        assert((w > 0) && (w <= MaxWeight));
+        weightMasks[w] |= bit;
+      }
+    }
+    Torques(state.board, &torqueL, &torqueR);
+    const Player* players[] = { &state.red, &state.blue };
+    for (int playerIdx = 0; playerIdx < 2; ++playerIdx)
+    {
+      handMasks[playerIdx] = 0U;
+      for (int wIdx = 0; wIdx < Player::NumWeights; ++wIdx)
+      {
+        const Weight w = players[playerIdx]->hand[wIdx];
+        hands[playerIdx][wIdx] = w;
+        if (Player::Played != w)
+        {
+          assert((w > 0) && (w <= MaxWeight));
+          handMasks[playerIdx] |= 1U << wIdx;
+        }
+      }
+    }
+    turn = state.turn;
+    phase = state.phase;
+  }
+
+  /// <summary> Positions where the weight may be added without tipping. </summary>
+  inline PositionMask AddMask(const Weight w) const
+  {
+    assert(w > 0);
+    // torqueL + w(PivotL - pos) <= 0 and torqueR + w(PivotR - pos) >= 0.
+    return IntervalMask(Board::PivotL - ((-torqueL) / w),
+                        Board::PivotR + (torqueR / w));
+  }
+
+  /// <summary> Positions where the weight may be removed without tipping. </summary>
+  inline PositionMask RemoveMask(const Weight w) const
+  {
+    assert(w > 0);
+    // torqueL - w(PivotL - pos) <= 0 and torqueR - w(PivotR - pos) >= 0.
+    return IntervalMask(Board::PivotR - (torqueR / w),
+                        Board::PivotL + ((-torqueL) / w));
+  }
+
+  /// <summary> Draw a uniformly random legal ply. </summary>
+  /// <returns> False when the player to move has no legal ply. </returns>
+  template <typename Engine>
+  bool RandomPly(Engine* rng, Ply* ply) const
+  {
+    assert(rng && ply);
+    assert((torqueL <= 0) && (torqueR >= 0));
+    if (State::Phase_Adding == phase)
+    {
+      const int playerIdx = (State::Turn_Red == turn) ? 0 : 1;
+      const unsigned int handMask = handMasks[playerIdx];
+      PositionMask legal[Player::NumWeights];
+      unsigned int total = 0;
+      for (int wIdx = 0; wIdx < Player::NumWeights; ++wIdx)
+      {
+        legal[wIdx] = 0U;
+        if (handMask & (1U << wIdx))
+        {
+          legal[wIdx] = AddMask(hands[playerIdx][wIdx]) & emptyMask;
+          total += detail::PopCount(legal[wIdx]);
+        }
+      }
+      if (0U == total)
+      {
+        return false;
+      }
+      unsigned int rank = rng->Bound(total);
+      for (int wIdx = 0;; ++wIdx)
+      {
+        const unsigned int count = detail::PopCount(legal[wIdx]);
+        if (rank < count)
+        {
+          const int posIdx = static_cast<int>(detail::SelectBit(legal[wIdx],
+                                                                rank));
+          *ply = Ply(posIdx - Board::Size, wIdx);
+          return true;
+        }
+        rank -= count;
+      }
+    }
+    else
+    {
+      PositionMask legal = 0U;
+      for (Weight w = 1; w <= MaxWeight; ++w)
+      {
+        if (0U != weightMasks[w])
+        {
+          legal |= weightMasks[w] & RemoveMask(w);
+        }
+      }
+      legal &= ~(1U << (Board::Positions - 1));
+      const unsigned int total = detail::PopCount(legal);
+      if (0U == total)
+      {
+        return false;
+      }
+      const unsigned int rank = rng->Bound(total);
+      *ply = Ply(static_cast<int>(detail::SelectBit(legal, rank)) -
+                 Board::Size);
+      return true;
+    }
+  }
+
+  /// <summary> Apply a legal ply. </summary>
+  inline void DoPly(const Ply& ply)
+  {
+    const int posIdx = ply.pos + Board::Size;
+    assert((posIdx >= 0) && (posIdx < Board::Positions));
+    const PositionMask bit = 1U << posIdx;
+    if (State::Phase_Adding == phase)
+    {
+      assert(emptyMask & bit);
+      const int playerIdx = (State::Turn_Red == turn) ? 0 : 1;
+      const Weight w = hands[playerIdx][ply.wIdx];
+      handMasks[playerIdx] &= ~(1U << ply.wIdx);
+      weights[posIdx] = w;
+      emptyMask &= ~bit;
+      weightMasks[w] |= bit;
+      torqueL += w * (Board::PivotL - ply.pos);
+      torqueR += w * (Board::PivotR - ply.pos);
+      if (0U == (handMasks[0] | handMasks[1]))
+      {
+        phase = State::Phase_Removing;
+      }
+    }
+    else
+    {
+      assert(!(emptyMask & bit));
+      const Weight w = weights[posIdx];
+      weights[posIdx] = Board::Empty;
+      emptyMask |= bit;
+      weightMasks[w] &= ~bit;
+      torqueL -= w * (Board::PivotL - ply.pos);
+      torqueR -= w * (Board::PivotR - ply.pos);
+    }
+    NextTurn(&turn);
+  }
+
+  /// <summary> Play random legal plys until a player has none. </summary>
+  /// <returns> The winner. </returns>
+  template <typename Engine>
+  State::Turn Run(Engine* rng)
+  {
+    Ply ply;
+    while (RandomPly(rng, &ply))
+    {
+      DoPly(ply);
+    }
+    // The player to move must tip the board.
+    State::Turn winner = turn;
+    NextTurn(&winner);
+    return winner;
+  }
+
+  /// <summary> Mask of the positions in [lo, hi] that are on the board. </summary>
+  static inline PositionMask IntervalMask(int lo, int hi)
+  {
+    lo = std::max(lo, -static_cast<int>(Board::Size));
+    hi = std::min(hi, static_cast<int>(Board::Size));
+    if (lo > hi)
+    {
+      return 0U;
+    }
+    const PositionMask ones = ~0U >> (31 - (hi - lo));
+    return ones << (lo + Board::Size);
+  }
+
+  Weight weights[Board::Positions];
+  PositionMask emptyMask;
+  /// <summary> Positions holding each weight value. </summary>
+  PositionMask weightMasks[MaxWeight + 1];
+  /// <summary> Weight indices still in each hand, red first. </summary>
+  unsigned int handMasks[2];
+  Weight hands[2][Player::NumWeights];
+  int torqueL;
+  int torqueR;
+  State::Turn turn;
+  State::Phase phase;
+};
+
+/// <summary> Random playouts of many games from one position in lockstep. </summary>
+/// <remarks>
+///   <para> Every lane starts from the same board, so the turn and the phase
+///     are shared and each step plays one ply in every lane that is still
+///     going. Lanes are laid out as structures of arrays. The legal position
+///     masks of all lanes are computed in branch-free loops that the
+///     compiler vectorizes, dividing a torque by a weight with a multiply by
+///     its rounded up reciprocal. Drawing and applying the plys is scalar.
+///   </para>
+///   <para> A lane ends when its player to move has no legal ply, as in
+///     PlayoutBoard::Run().
+///   </para>
+/// </remarks>
+struct PlayoutBatch
+{
+  typedef PlayoutBoard::PositionMask PositionMask;
+  enum { Lanes = 16, };
+  enum { MaxWeight = PlayoutBoard::MaxWeight, };
+  enum { ReciprocalShift = 19, };
+  /// <summary> Bound on the torque magnitude of a board that is up. </summary>
+  enum { MaxTorque = 1 << 12, };
+
+  PlayoutBatch()
+    : active(0U),
+      turn(State::Turn_Red),
+      phase(State::Phase_Adding)
+  {
+    memset(torqueL, 0, sizeof(torqueL));
+    memset(torqueR, 0, sizeof(torqueR));
+    memset(emptyMasks, 0, sizeof(emptyMasks));
+    memset(weightMasks, 0, sizeof(weightMasks));
+    memset(handMasks, 0, sizeof(handMasks));
+    memset(hands, 0, sizeof(hands));
+    memset(legal, 0, sizeof(legal));
+  }
+
+  /// <summary> Start every lane from the board. </summary>
+  void Load(const PlayoutBoard& board)
+  {
+    assert((board.torqueL <= 0) && (board.torqueR >= 0));
+    for (int lane = 0; lane < Lanes; ++lane)
+    {
+      torqueL[lane] = board.torqueL;
+      torqueR[lane] = board.torqueR;
+      emptyMasks[lane] = board.emptyMask;
+      handMasks[0][lane] = board.handMasks[0];
+      handMasks[1][lane] = board.handMasks[1];
+      for (Weight w = 0; w <= MaxWeight; ++w)
+      {
+        weightMasks[w][lane] = board.weightMasks[w];
+      }
+      winners[lane] = board.turn;
+    }
+    memcpy(hands, board.hands, sizeof(hands));
+    active = (1U << Lanes) - 1U;
+    turn = board.turn;
+    phase = board.phase;
+  }
+
+  /// <summary> Play every lane to the end. </summary>
+  /// <remarks>
+  ///   <para> The first ply of each lane is kept in firstPlys. A lane whose
+  ///     first player has no legal ply keeps a default ply.
+  ///   </para>
+  /// </remarks>
+  template <typename Engine>
+  void Run(Engine* rng)
+  {
+    assert(rng);
+    for (int lane = 0; lane < Lanes; ++lane)
+    {
+      firstPlys[lane] = Ply();
+    }
+    for (bool first = true; 0U != active; first = false)
+    {
+      const int playerIdx = (State::Turn_Red == turn) ? 0 : 1;
+      const int slots = (State::Phase_Adding == phase) ? Player::NumWeights : 1;
+      if (State::Phase_Adding == phase)
+      {
+        AddMasks(playerIdx);
+      }
+      else
+      {
+        RemoveMasks();
+      }
+      // Draw and apply a ply in each lane that is still going.
+      // The player to move in a lane without a legal ply must tip the board.
+      State::Turn winner = turn;
+      NextTurn(&winner);
+      for (unsigned int lanes = active; 0U != lanes; lanes &= lanes - 1U)
+      {
+        const int lane = static_cast<int>(detail::SelectBit(lanes, 0));
+        unsigned int total = 0;
+        for (int slot = 0; slot < slots; ++slot)
+        {
+          total += detail::PopCount(legal[slot][lane]);
+        }
+        if (0U == total)
+        {
+          winners[lane] = winner;
+          active &= ~(1U << lane);
+          continue;
+        }
+        unsigned int rank = rng->Bound(total);
+        int slot = 0;
+        for (;; ++slot)
+        {
+          const unsigned int count = detail::PopCount(legal[slot][lane]);
+          if (rank < count)
+          {
+            break;
+          }
+          rank -= count;
+        }
+        const int posIdx = static_cast<int>(detail::SelectBit(legal[slot][lane],
+                                                              rank));
+        const Ply ply = (State::Phase_Adding == phase) ?
+                        Ply(posIdx - Board::Size, slot) :
+                        Ply(posIdx - Board::Size);
+        if (first)
+        {
+          firstPlys[lane] = ply;
+        }
+        DoPly(lane, playerIdx, ply);
+      }
+      NextTurn(&turn);
+      if ((State::Phase_Adding == phase) && (0U == HandsLeft()))
+      {
+        phase = State::Phase_Removing;
+      }
+    }
+  }
+
+  /// <summary> Rounded up 2^ReciprocalShift / w. </summary>
+  /// <remarks>
+  ///   <para> (t * Reciprocal(w)) >> ReciprocalShift is t / w for
+  ///     0 <= t < MaxTorque. The rounding adds less than 2^-7 to a quotient
+  ///     whose fraction is at most (w - 1) / w, and the product fits in 32
+  ///     bits.
+  ///   </para>
+  /// </remarks>
+  static inline unsigned int Reciprocal(const Weight w)
+  {
+    assert((w > 0) && (w <= MaxWeight));
+    return ((1U << ReciprocalShift) + static_cast<unsigned int>(w) - 1U) /
+           static_cast<unsigned int>(w);
+  }
+
+  /// <summary> t / w for the reciprocal of w. </summary>
+  static inline int Divide(const int t, const unsigned int recip)
+  {
+    assert((t >= 0) && (t < MaxTorque));
+    return static_cast<int>((static_cast<unsigned int>(t) * recip) >>
+                            ReciprocalShift);
+  }
+
+  /// <summary> Mask of the positions in [lo, hi] that are on the board,
+  ///   without branches.
+  /// </summary>
+  static inline PositionMask IntervalMask(int lo, int hi)
+  {
+    lo = std::min(std::max(lo, -static_cast<int>(Board::Size)),
+                  static_cast<int>(Board::Size));
+    hi = std::min(hi, static_cast<int>(Board::Size));
+    const int span = hi - lo;
+    const PositionMask ones = ~0U >> (31 - std::max(span, 0));
+    return (ones << (lo + Board::Size)) & (0U - (span >= 0));
+  }
+
+  /// <summary> Legal positions of each hand slot of the player in every lane. </summary>
+  void AddMasks(const int playerIdx)
+  {
+    for (int wIdx = 0; wIdx < Player::NumWeights; ++wIdx)
+    {
+      const Weight w = hands[playerIdx][wIdx];
+      if (Player::Played == w)
+      {
+        memset(legal[wIdx], 0, sizeof(legal[wIdx]));
+        continue;
+      }
+      const unsigned int recip = Reciprocal(w);
+      const unsigned int* handMask = handMasks[playerIdx];
+      PositionMask* slotLegal = legal[wIdx];
+      for (int lane = 0; lane < Lanes; ++lane)
+      {
+        const int qa = Divide(-torqueL[lane], recip);
+        const int qb = Divide(torqueR[lane], recip);
+        const PositionMask inHand = 0U - ((handMask[lane] >> wIdx) & 1U);
+        slotLegal[lane] = IntervalMask(Board::PivotL - qa, Board::PivotR + qb) &
+                          emptyMasks[lane] & inHand;
+      }
+    }
+  }
+
+  /// <summary> Legal removals of every lane in the first slot. </summary>
+  void RemoveMasks()
+  {
+    PositionMask* slotLegal = legal[0];
+    memset(slotLegal, 0, sizeof(legal[0]));
+    for (Weight w = 1; w <= MaxWeight; ++w)
+    {
+      const unsigned int recip = Reciprocal(w);
+      const PositionMask* atWeight = weightMasks[w];
+      for (int lane = 0; lane < Lanes; ++lane)
+      {
+        const int qa = Divide(-torqueL[lane], recip);
+        const int qb = Divide(torqueR[lane], recip);
+        slotLegal[lane] |= IntervalMask(Board::PivotR - qb,
+                                        Board::PivotL + qa) & atWeight[lane];
+      }
+    }
+    // PossiblePlys() never removes from the last position.
+    const PositionMask lastPos = 1U << (Board::Positions - 1);
+    for (int lane = 0; lane < Lanes; ++lane)
+    {
+      slotLegal[lane] &= ~lastPos;
+    }
+  }
+
+  /// <summary> Apply a legal ply in one lane. </summary>
+  inline void DoPly(const int lane, const int playerIdx, const Ply& ply)
+  {
+    const int posIdx = ply.pos + Board::Size;
+    const PositionMask bit = 1U << posIdx;
+    Weight w;
+    if (State::Phase_Adding == phase)
+    {
+      w = hands[playerIdx][ply.wIdx];
+      handMasks[playerIdx][lane] &= ~(1U << ply.wIdx);
+      emptyMasks[lane] &= ~bit;
+      weightMasks[w][lane] |= bit;
+    }
+    else
+    {
+      // Find the weight from the masks rather than keep a board per lane.
+      w = 1;
+      while (0U == (weightMasks[w][lane] & bit))
+      {
+        ++w;
+        assert(w <= MaxWeight);
+      }
+      weightMasks[w][lane] &= ~bit;
+      emptyMasks[lane] |= bit;
+      w = -w;
+    }
+    torqueL[lane] += w * (Board::PivotL - ply.pos);
+    torqueR[lane] += w * (Board::PivotR - ply.pos);
+  }
+
+  /// <summary> Weights left in any hand of any lane still going. </summary>
+  inline unsigned int HandsLeft() const
+  {
+    unsigned int left = 0U;
+    for (unsigned int lanes = active; 0U != lanes; lanes &= lanes - 1U)
+    {
+      const int lane = static_cast<int>(detail::SelectBit(lanes, 0));
+      left |= handMasks[0][lane] | handMasks[1][lane];
+    }
+    return left;
+  }
+
+  Ply firstPlys[Lanes];
+  State::Turn winners[Lanes];
+  /// <summary> Lanes still going, one bit per lane. </summary>
+  unsigned int active;
+  State::Turn turn;
+  State::Phase phase;
+  int torqueL[Lanes];
+  int torqueR[Lanes];
+  PositionMask emptyMasks[Lanes];
+  PositionMask weightMasks[MaxWeight + 1][Lanes];
+  unsigned int handMasks[2][Lanes];
+  /// <summary> Hand weights, which are the same in every lane. </summary>
+  Weight hands[2][Player::NumWeights];
+  /// <summary> Legal positions per hand slot of the last step. </summary>
+  PositionMask legal[Player::NumWeights][Lanes];
+};
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_PLAYOUT_H_
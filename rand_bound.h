@@ -1,28 +1,128 @@
 #ifndef _MATH_RAND_BOUND_GENERATOR_H_
 #define _MATH_RAND_BOUND_GENERATOR_H_
 #include <math.h>
-#include <cstdlib>
 #include <assert.h>
+#include <algorithm>
+#include <cstddef>
 
 namespace hps
 {
 namespace math
 {
 
+/// <summary> A xoshiro256** pseudorandom number engine. </summary>
+/// <remarks>
+///   <para> The engine is small and cheap to copy, so each thread should own
+///     one rather than share a global source. The state is filled from a
+///     SplitMix64 sequence of the seed, so nearby seeds give unrelated
+///     streams.
+///   </para>
+/// </remarks>
+class RandomEngine
+{
+public:
+  typedef unsigned long long result_type;
+  enum { DefaultSeed = 0x52414e44, };
+
+  explicit RandomEngine(const unsigned long long seed = DefaultSeed)
+  {
+    Seed(seed);
+  }
+
+  void Seed(unsigned long long seed)
+  {
+    for (int sIdx = 0; sIdx < 4; ++sIdx)
+    {
+      unsigned long long z = (seed += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      m_s[sIdx] = z ^ (z >> 31);
+    }
+  }
+
+  /// <summary> Next 64 random bits. </summary>
+  inline unsigned long long operator()()
+  {
+    const unsigned long long result = Rotl(m_s[1] * 5ULL, 7) * 9ULL;
+    const unsigned long long t = m_s[1] << 17;
+    m_s[2] ^= m_s[0];
+    m_s[3] ^= m_s[1];
+    m_s[1] ^= m_s[2];
+    m_s[0] ^= m_s[3];
+    m_s[2] ^= t;
+    m_s[3] = Rotl(m_s[3], 45);
+    return result;
+  }
+
+  /// <summary> Unbiased value in [0, bound - 1]. </summary>
+  /// <remarks>
+  ///   <para> Scales the high 32 bits by the bound and rejects the few low
+  ///     products that would favor some values (Lemire's method), so the
+  ///     common case costs one multiply and no division.
+  ///   </para>
+  /// </remarks>
+  inline unsigned int Bound(const unsigned int bound)
+  {
+    assert(bound > 0);
+    unsigned long long m = ((*this)() >> 32) * bound;
+    unsigned int low = static_cast<unsigned int>(m);
+    if (low < bound)
+    {
+      const unsigned int threshold = (0U - bound) % bound;
+      while (low < threshold)
+      {
+        m = ((*this)() >> 32) * bound;
+        low = static_cast<unsigned int>(m);
+      }
+    }
+    return static_cast<unsigned int>(m >> 32);
+  }
+
+  /// <summary> Uniform value in [0, 1). </summary>
+  inline double Uniform()
+  {
+    return static_cast<double>((*this)() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  static inline unsigned long long Rotl(const unsigned long long x,
+                                        const int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  unsigned long long m_s[4];
+};
+
+/// <summary> The engine used by draws that are not given one. </summary>
+/// <remarks>
+///   <para> It is shared, so it is only for code that draws from a single
+///     thread such as tests. Threaded code must pass its own engine.
+///   </para>
+/// </remarks>
+inline RandomEngine& DefaultRandomEngine()
+{
+  static RandomEngine s_engine;
+  return s_engine;
+}
+
 /// <summary> Partition consecutive intervals of size bound mapped to the
 ///   numbers [0, bound - 1].
 /// </summary>
-int RandBound(const int bound)
+template <typename Engine>
+inline int RandBound(Engine* rng, const int bound)
 {
-  assert(bound <= RAND_MAX);
-  int factor = ((RAND_MAX - bound) / bound) + 1;
-  int limit = factor * bound;
-  int r;
-  do
-  {
-    r = rand();
-  } while (r >= limit);
-  return r / factor;
+  assert(rng);
+  assert(bound > 0);
+  return static_cast<int>(rng->Bound(static_cast<unsigned int>(bound)));
+}
+
+/// <summary> Partition consecutive intervals of size bound mapped to the
+///   numbers [0, bound - 1].
+/// </summary>
+inline int RandBound(const int bound)
+{
+  return RandBound(&DefaultRandomEngine(), bound);
 }
 
 /// <summary> Partition consecutive intervals of size bound mapped to the
@@ -31,34 +131,57 @@ int RandBound(const int bound)
 struct RandBoundGenerator
 {
   RandBoundGenerator(const int bound_)
-  : bound(bound_),
-    factor(((RAND_MAX - bound) / bound) + 1),
-    limit(factor * bound)
+  : bound(bound_)
   {
-    assert(bound <= RAND_MAX);
+    assert(bound > 0);
   }
 
   inline int operator()() const
   {
-    int r;
-    do
-    {
-      r = rand();
-    } while (r >= limit);
-    return r / factor;
+    return RandBound(bound);
+  }
+
+  template <typename Engine>
+  inline int operator()(Engine* rng) const
+  {
+    return RandBound(rng, bound);
   }
 
   int bound;
-  int factor;
-  int limit;
 };
 
+/// <summary> Shuffle a range with the Fisher-Yates method. </summary>
+template <typename RandomAccessIterator, typename Engine>
+inline void RandomShuffle(RandomAccessIterator first,
+                          RandomAccessIterator last,
+                          Engine* rng)
+{
+  assert(rng);
+  for (ptrdiff_t i = (last - first) - 1; i > 0; --i)
+  {
+    std::swap(first[i], first[RandBound(rng, static_cast<int>(i + 1))]);
+  }
+}
+
+/// <summary> Shuffle a range with the Fisher-Yates method. </summary>
+template <typename RandomAccessIterator>
+inline void RandomShuffle(RandomAccessIterator first,
+                          RandomAccessIterator last)
+{
+  RandomShuffle(first, last, &DefaultRandomEngine());
+}
+
+template <typename NumericType, typename Engine>
+inline NumericType RandUniform(Engine* rng)
+{
+  assert(rng);
+  return static_cast<NumericType>(rng->Uniform());
+}
+
 template <typename NumericType>
 inline NumericType RandUniform()
 {
-  static RandBoundGenerator s_rand(RAND_MAX);
-  return static_cast<NumericType>(s_rand()) /
-         static_cast<NumericType>(RAND_MAX - 1);
+  return RandUniform<NumericType>(&DefaultRandomEngine());
 }
 
 /// <summary> Generate values from a normal distribution using ratio of uniforms. </summary>
@@ -71,8 +194,10 @@ inline NumericType RandUniform()
 ///       NY, USA.
 ///   </para>
 /// </remarks>
-double RatioOfUniforms(const double mu, const double sig)
+template <typename Engine>
+double RatioOfUniforms(Engine* rng, const double mu, const double sig)
 {
+  assert(rng);
   // Uses a squeeze on the cartesion plot of standard distribution region
   // to reject efficiently (u,v) not in the allowed region. Since (u,v) is
   // selected uniformly, the coordinates allowed model the normal distribution
@@ -80,18 +205,24 @@ double RatioOfUniforms(const double mu, const double sig)
   double u, v, x, y, q;
   do
   {
-    u = RandUniform<double>();
+    u = RandUniform<double>(rng);
     {
-      v = 1.7156 * (RandUniform<double>() - 0.5);
+      v = 1.7156 * (RandUniform<double>(rng) - 0.5);
     }
     x = u - 0.449871;
     y = fabs(v) + 0.386596;
     q = (x * x) + (y * ((0.19600 * y) - (0.25472 * x)));
-  } while ((q > 0.27597) &&
-           ((q > 0.27846) || ((v * v) > (-4.0 * log(u) * (u * u)))));
+  } while ((u <= 0.0) ||
+           ((q > 0.27597) &&
+            ((q > 0.27846) || ((v * v) > (-4.0 * log(u) * (u * u))))));
   return mu + (sig * (v / u));
 }
 
+inline double RatioOfUniforms(const double mu, const double sig)
+{
+  return RatioOfUniforms(&DefaultRandomEngine(), mu, sig);
+}
+
 }
 using namespace math;
 }
@@ -29,6 +29,73 @@ TEST(RandBound, RatioOfUniforms)
   }
 }
 
+TEST(RandBound, RandomEngine)
+{
+  // The same seed gives the same stream.
+  {
+    RandomEngine lhs(7);
+    RandomEngine rhs(7);
+    RandomEngine other(8);
+    int same = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+      const unsigned long long value = lhs();
+      EXPECT_EQ(value, rhs());
+      same += (value == other());
+    }
+    EXPECT_EQ(0, same);
+  }
+  // Bounded draws cover the range evenly.
+  {
+    enum { Bound = 7, };
+    enum { Draws = 70000, };
+    RandomEngine rng;
+    std::vector<int> hist(Bound, 0);
+    for (int i = 0; i < Draws; ++i)
+    {
+      const int value = RandBound(&rng, Bound);
+      ASSERT_GE(value, 0);
+      ASSERT_LT(value, static_cast<int>(Bound));
+      ++hist[value];
+    }
+    for (int i = 0; i < Bound; ++i)
+    {
+      EXPECT_NEAR(Draws / Bound, hist[i], 500);
+    }
+    EXPECT_EQ(0, RandBound(&rng, 1));
+  }
+  // Uniform values lie in [0, 1).
+  {
+    RandomEngine rng;
+    double sum = 0.0;
+    for (int i = 0; i < 10000; ++i)
+    {
+      const double value = RandUniform<double>(&rng);
+      ASSERT_GE(value, 0.0);
+      ASSERT_LT(value, 1.0);
+      sum += value;
+    }
+    EXPECT_NEAR(0.5, sum / 10000, 0.02);
+  }
+  // A shuffle is a permutation.
+  {
+    RandomEngine rng;
+    std::vector<int> seq(50);
+    for (int i = 0; i < static_cast<int>(seq.size()); ++i)
+    {
+      seq[i] = i;
+    }
+    RandomShuffle(seq.begin(), seq.end(), &rng);
+    std::vector<int> sorted(seq);
+    std::sort(sorted.begin(), sorted.end());
+    for (int i = 0; i < static_cast<int>(sorted.size()); ++i)
+    {
+      EXPECT_EQ(i, sorted[i]);
+    }
+    EXPECT_FALSE(std::equal(seq.begin(), seq.end(), sorted.begin()));
+  }
+}
+
 }
 
 #endif //_HPS_AMBULANCE_RAND_BOUND_GTEST_H_
@@ -0,0 +1,132 @@
+#ifndef _HPS_UTIL_THREAD_H_
+#define _HPS_UTIL_THREAD_H_
+#include <cstddef>
+
+#ifdef WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace hps
+{
+namespace util
+{
+
+/// <summary> A native thread that runs one function to completion. </summary>
+/// <remarks>
+///   <para> Work inside the function may still use OpenMP; the thread only
+///     provides concurrency with the thread that started it.
+///   </para>
+/// </remarks>
+class Thread
+{
+public:
+  typedef void (*Function)(void* arg);
+
+#ifdef WIN32
+  Thread()
+    : m_func(NULL),
+      m_arg(NULL),
+      m_thread(NULL)
+  {}
+
+  bool Start(Function func, void* arg)
+  {
+    Join();
+    m_func = func;
+    m_arg = arg;
+    m_thread = CreateThread(NULL, 0, &Thread::Entry, this, 0, NULL);
+    return NULL != m_thread;
+  }
+
+  void Join()
+  {
+    if (NULL != m_thread)
+    {
+      WaitForSingleObject(m_thread, INFINITE);
+      CloseHandle(m_thread);
+      m_thread = NULL;
+    }
+  }
+
+  inline bool IsStarted() const
+  {
+    return NULL != m_thread;
+  }
+
+private:
+  static DWORD WINAPI Entry(LPVOID self)
+  {
+    Thread* thread = static_cast<Thread*>(self);
+    thread->m_func(thread->m_arg);
+    return 0;
+  }
+
+  Function m_func;
+  void* m_arg;
+  HANDLE m_thread;
+#else
+  Thread()
+    : m_func(NULL),
+      m_arg(NULL),
+      m_thread(),
+      m_started(false)
+  {}
+
+  bool Start(Function func, void* arg)
+  {
+    Join();
+    m_func = func;
+    m_arg = arg;
+    m_started = (0 == pthread_create(&m_thread, NULL, &Thread::Entry, this));
+    return m_started;
+  }
+
+  void Join()
+  {
+    if (m_started)
+    {
+      pthread_join(m_thread, NULL);
+      m_started = false;
+    }
+  }
+
+  inline bool IsStarted() const
+  {
+    return m_started;
+  }
+
+private:
+  static void* Entry(void* self)
+  {
+    Thread* thread = static_cast<Thread*>(self);
+    thread->m_func(thread->m_arg);
+    return NULL;
+  }
+
+  Function m_func;
+  void* m_arg;
+  pthread_t m_thread;
+  bool m_started;
+#endif
+
+public:
+  ~Thread()
+  {
+    Join();
+  }
+
+private:
+  // Not copyable.
+  Thread(const Thread&);
+  Thread& operator=(const Thread&);
+};
+
+}
+using namespace util;
+}
+
+#endif //_HPS_UTIL_THREAD_H_
@@ -0,0 +1,145 @@
+#ifndef _NO_TIPPING_GAME_TIME_MANAGER_H_
+#define _NO_TIPPING_GAME_TIME_MANAGER_H_
+#include "depth_controller.h"
+#include "ntg.h"
+#include <algorithm>
+#include <cmath>
+
+namespace hps
+{
+namespace ntg
+{
+
+/// <summary> Splits the time budget of a game between the moves of a side. </summary>
+/// <remarks>
+///   <para> Each move is allotted a share of the remaining budget in
+///     proportion to its weight among the moves the side has left. The late
+///     adding and early removing plys decide most games and weigh the most.
+///     The share is then scaled by how wide the position is compared with a
+///     typical one of its phase. A forced move gets no search time.
+///   </para>
+///   <para> The soft deadline is the time the search should plan to use.
+///     The hard deadline is where a search is aborted, so a misjudged wide
+///     position cannot lose the game on time.
+///   </para>
+/// </remarks>
+struct TimeManager
+{
+  /// <summary> Time limits for one move in seconds. </summary>
+  struct Deadlines
+  {
+    Deadlines()
+      : soft(0.0),
+        hard(0.0)
+    {}
+
+    double soft;
+    double hard;
+  };
+
+  /// <summary> Plys in a random game's position on average. </summary>
+  enum { TypicalPlysAdding = 46, };
+  enum { TypicalPlysRemoving = 9, };
+  /// <summary> Plys before the end of the adding phase that weigh more. </summary>
+  enum { CriticalPlysAdding = 8, };
+  /// <summary> Plys into the removing phase that weigh more. </summary>
+  enum { CriticalPlysRemoving = 6, };
+
+  TimeManager()
+    : budget(120.0),
+      reserve(5.0),
+      hardFactor(2.0),
+      maxShare(0.25),
+      minHardTime(0.05),
+      used(0.0)
+  {}
+
+  void StartGame()
+  {
+    used = 0.0;
+  }
+
+  /// <summary> Add the time taken by a move. </summary>
+  void Spend(const double seconds)
+  {
+    used += seconds;
+  }
+
+  /// <summary> Budget left after the reserve. </summary>
+  inline double Remaining() const
+  {
+    return std::max(0.0, budget - reserve - used);
+  }
+
+  /// <summary> Weight of the move at the ply index. </summary>
+  static inline double MoveWeight(const int plyIdx)
+  {
+    if (plyIdx < (State::NumAdded - CriticalPlysAdding))
+    {
+      return 1.0;
+    }
+    else if (plyIdx < (State::NumAdded + CriticalPlysRemoving))
+    {
+      return 2.0;
+    }
+    return 0.5;
+  }
+
+  /// <summary> Scale for a position with the number of plys. </summary>
+  static inline double Difficulty(const State::Phase phase, const int numPlys)
+  {
+    const double typicalPlys = (State::Phase_Adding == phase) ?
+                               static_cast<double>(TypicalPlysAdding) :
+                               static_cast<double>(TypicalPlysRemoving);
+    const double difficulty = std::sqrt(numPlys / typicalPlys);
+    return std::min(2.0, std::max(0.5, difficulty));
+  }
+
+  /// <summary> Get the deadlines for a move of the state with the number of
+  ///   plys.
+  /// </summary>
+  Deadlines Allocate(const State& state, const int numPlys) const
+  {
+    Deadlines deadlines;
+    const double remaining = Remaining();
+    if (numPlys <= 1)
+    {
+      deadlines.hard = minHardTime;
+      return deadlines;
+    }
+    // Share the budget among the moves left to this side.
+    const int plyIdx = State::MaxPlys - DepthController::PlysLeft(state);
+    double totalWeight = 0.0;
+    for (int movePlyIdx = plyIdx;
+         movePlyIdx < State::MaxPlys;
+         movePlyIdx += 2)
+    {
+      totalWeight += MoveWeight(movePlyIdx);
+    }
+    const double share = MoveWeight(plyIdx) / std::max(totalWeight, 1.0);
+    const double soft = remaining * share * Difficulty(state.phase, numPlys);
+    deadlines.hard = std::min(hardFactor * soft, maxShare * remaining);
+    deadlines.hard = std::max(deadlines.hard, minHardTime);
+    deadlines.soft = std::min(soft, deadlines.hard);
+    return deadlines;
+  }
+
+  /// <summary> Seconds a side may use in a game. </summary>
+  double budget;
+  /// <summary> Seconds kept back for time spent outside the search. </summary>
+  double reserve;
+  /// <summary> Hard deadline as a multiple of the soft one. </summary>
+  double hardFactor;
+  /// <summary> Largest part of the remaining time a move may use. </summary>
+  double maxShare;
+  /// <summary> Shortest hard deadline, even with no time left. </summary>
+  double minHardTime;
+  /// <summary> Seconds used in the current game. </summary>
+  double used;
+};
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_TIME_MANAGER_H_
@@ -0,0 +1,308 @@
+#include "win_state_table.h"
+#include "adversarial_utils.h"
+#include <climits>
+#include <fstream>
+
+namespace hps
+{
+namespace ntg
+{
+
+namespace detail
+{
+struct WinStateTableHeader
+{
+  char magic[8];
+  unsigned int version;
+  unsigned int numLayers;
+  unsigned long long keyChecksum;
+};
+
+struct WinStateTableLayerRecord
+{
+  int numWeights;
+  int filterShift;
+  unsigned long long stateCount;
+  unsigned long long statesOffset;
+  unsigned long long filterWords;
+  unsigned long long filterOffset;
+  unsigned long long packedStatesOffset;
+  unsigned long long touchingBeginOffset;
+  unsigned long long touchingCount;
+  unsigned long long touchingOffset;
+};
+
+typedef BoardEvaluationReachableWinStates::NumWeightsWinStates
+  NumWeightsWinStates;
+
+/// <summary> 64-bit words per packed sub-board. </summary>
+enum { PackedStateWords = sizeof(PackedSubBoard) / sizeof(unsigned long long), };
+typedef char PackedStateWordsCheck[
+  (sizeof(PackedSubBoard) ==
+   (PackedStateWords * sizeof(unsigned long long))) ? 1 : -1];
+
+/// <summary> Entries of touchingBegin, the last being the end offset. </summary>
+enum { TouchingBeginCount = NumWeightsWinStates::TouchingSlots + 1, };
+
+const char WinStateTableMagic[8] = { 'N', 'T', 'G', 'W', 'I', 'N', 'S', 'T' };
+
+/// <summary> Test that an array lies inside the file and is aligned. </summary>
+bool ArrayInFile(const unsigned long long offset,
+                 const unsigned long long count,
+                 const size_t fileSize,
+                 const unsigned long long elementSize)
+{
+  const bool aligned = (0 == (offset % elementSize));
+  const bool countFits = (count <= (fileSize / elementSize));
+  return aligned && countFits && (offset <= fileSize) &&
+         ((count * elementSize) <= (fileSize - offset));
+}
+
+/// <summary> Test that keys are strictly ascending for the key searches. </summary>
+bool KeysAscending(const unsigned long long* keys, const size_t count)
+{
+  for (size_t keyIdx = 1; keyIdx < count; ++keyIdx)
+  {
+    if (keys[keyIdx - 1] >= keys[keyIdx])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// <summary> Test that the touching index is well formed for the states. </summary>
+bool TouchingIndexValid(const unsigned int* touchingBegin,
+                        const unsigned int* touching,
+                        const size_t touchingCount,
+                        const size_t stateCount)
+{
+  if ((0 != touchingBegin[0]) ||
+      (touchingCount != touchingBegin[TouchingBeginCount - 1]))
+  {
+    return false;
+  }
+  for (int slot = 1; slot < TouchingBeginCount; ++slot)
+  {
+    if (touchingBegin[slot - 1] > touchingBegin[slot])
+    {
+      return false;
+    }
+  }
+  for (size_t idx = 0; idx < touchingCount; ++idx)
+  {
+    if (touching[idx] >= stateCount)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// <summary> Round an offset up to a whole 64-bit word. </summary>
+inline unsigned long long AlignToWord(const unsigned long long offset)
+{
+  const unsigned long long wordSize = sizeof(unsigned long long);
+  return (offset + (wordSize - 1)) & ~(wordSize - 1);
+}
+}
+
+bool WinStateTable::Load(const char* filename)
+{
+  using namespace detail;
+  assert(filename);
+
+  m_layers.clear();
+  if (!m_file.Open(filename))
+  {
+    return false;
+  }
+  const char* data = static_cast<const char*>(m_file.GetData());
+  const size_t fileSize = m_file.GetSize();
+  // Validate header.
+  bool valid = (fileSize >= sizeof(WinStateTableHeader));
+  const WinStateTableHeader* header =
+    reinterpret_cast<const WinStateTableHeader*>(data);
+  if (valid)
+  {
+    valid = (0 == memcmp(header->magic, WinStateTableMagic,
+                         sizeof(WinStateTableMagic))) &&
+            (Version == header->version) &&
+            (PosWeightKeysChecksum() == header->keyChecksum) &&
+            (header->numLayers <= ((fileSize - sizeof(WinStateTableHeader)) /
+                                   sizeof(WinStateTableLayerRecord)));
+  }
+  // Validate and collect layers.
+  if (valid)
+  {
+    const WinStateTableLayerRecord* record =
+      reinterpret_cast<const WinStateTableLayerRecord*>(header + 1);
+    for (unsigned int layerIdx = 0;
+         valid && (layerIdx < header->numLayers);
+         ++layerIdx, ++record)
+    {
+      valid = (record->numWeights > 0) &&
+              (record->numWeights <= Board::Positions) &&
+              (record->filterShift > 0) &&
+              (record->filterShift <= 58) &&
+              (record->filterWords == (1ULL << (58 - record->filterShift))) &&
+              (record->stateCount <= UINT_MAX) &&
+              (record->touchingCount <= UINT_MAX) &&
+              ArrayInFile(record->statesOffset, record->stateCount, fileSize,
+                          sizeof(unsigned long long)) &&
+              ArrayInFile(record->filterOffset, record->filterWords, fileSize,
+                          sizeof(unsigned long long)) &&
+              ArrayInFile(record->packedStatesOffset,
+                          record->stateCount * PackedStateWords, fileSize,
+                          sizeof(unsigned long long)) &&
+              ArrayInFile(record->touchingBeginOffset, TouchingBeginCount,
+                          fileSize, sizeof(unsigned int)) &&
+              ArrayInFile(record->touchingOffset, record->touchingCount,
+                          fileSize, sizeof(unsigned int));
+      if (valid)
+      {
+        Layer layer;
+        layer.numWeights = record->numWeights;
+        layer.filterShift = record->filterShift;
+        layer.states = reinterpret_cast<const unsigned long long*>(
+          data + record->statesOffset);
+        layer.stateCount = static_cast<size_t>(record->stateCount);
+        layer.filter = reinterpret_cast<const unsigned long long*>(
+          data + record->filterOffset);
+        layer.filterWords = static_cast<size_t>(record->filterWords);
+        layer.packedStates = reinterpret_cast<const unsigned long long*>(
+          data + record->packedStatesOffset);
+        layer.touchingBegin = reinterpret_cast<const unsigned int*>(
+          data + record->touchingBeginOffset);
+        layer.touching = reinterpret_cast<const unsigned int*>(
+          data + record->touchingOffset);
+        layer.touchingCount = static_cast<size_t>(record->touchingCount);
+        valid = KeysAscending(layer.states, layer.stateCount) &&
+                TouchingIndexValid(layer.touchingBegin, layer.touching,
+                                   layer.touchingCount, layer.stateCount);
+        if (valid)
+        {
+          m_layers.push_back(layer);
+        }
+      }
+    }
+  }
+  if (!valid)
+  {
+    m_layers.clear();
+    m_file.Close();
+  }
+  return valid;
+}
+
+bool WinStateTable::Write(const char* filename, const LayerList& layers)
+{
+  using namespace detail;
+  assert(filename);
+
+  // Lay out the arrays after the header and layer records.
+  WinStateTableHeader header;
+  memcpy(header.magic, WinStateTableMagic, sizeof(WinStateTableMagic));
+  header.version = Version;
+  header.numLayers = static_cast<unsigned int>(layers.size());
+  header.keyChecksum = PosWeightKeysChecksum();
+  std::vector<WinStateTableLayerRecord> records(layers.size());
+  unsigned long long offset = sizeof(WinStateTableHeader) +
+                              (records.size() *
+                               sizeof(WinStateTableLayerRecord));
+  for (size_t layerIdx = 0; layerIdx < layers.size(); ++layerIdx)
+  {
+    const Layer& layer = layers[layerIdx];
+    WinStateTableLayerRecord& record = records[layerIdx];
+    record.numWeights = layer.numWeights;
+    record.filterShift = layer.filterShift;
+    record.stateCount = layer.stateCount;
+    record.statesOffset = offset;
+    offset += layer.stateCount * sizeof(unsigned long long);
+    record.filterWords = layer.filterWords;
+    record.filterOffset = offset;
+    offset += layer.filterWords * sizeof(unsigned long long);
+    record.packedStatesOffset = offset;
+    offset += layer.stateCount * sizeof(PackedSubBoard);
+    record.touchingBeginOffset = offset;
+    offset += TouchingBeginCount * sizeof(unsigned int);
+    record.touchingCount = layer.touchingCount;
+    record.touchingOffset = offset;
+    offset = AlignToWord(offset + (layer.touchingCount * sizeof(unsigned int)));
+  }
+  // Write out.
+  std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.good())
+  {
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!records.empty())
+  {
+    file.write(reinterpret_cast<const char*>(&records[0]),
+               records.size() * sizeof(WinStateTableLayerRecord));
+  }
+  for (size_t layerIdx = 0; layerIdx < layers.size(); ++layerIdx)
+  {
+    const Layer& layer = layers[layerIdx];
+    file.write(reinterpret_cast<const char*>(layer.states),
+               layer.stateCount * sizeof(unsigned long long));
+    file.write(reinterpret_cast<const char*>(layer.filter),
+               layer.filterWords * sizeof(unsigned long long));
+    file.write(reinterpret_cast<const char*>(layer.packedStates),
+               layer.stateCount * sizeof(PackedSubBoard));
+    file.write(reinterpret_cast<const char*>(layer.touchingBegin),
+               TouchingBeginCount * sizeof(unsigned int));
+    const unsigned long long touchingEnd =
+      records[layerIdx].touchingOffset +
+      (layer.touchingCount * sizeof(unsigned int));
+    file.write(reinterpret_cast<const char*>(layer.touching),
+               layer.touchingCount * sizeof(unsigned int));
+    // Pad so the next layer's keys are aligned.
+    const char padding[sizeof(unsigned long long)] = { 0 };
+    file.write(padding, AlignToWord(touchingEnd) - touchingEnd);
+  }
+  return file.good();
+}
+
+bool WriteStandardWinStateTable(const char* filename, const int maxWeights)
+{
+  typedef BoardEvaluationReachableWinStates::NumWeightsWinStates
+    NumWeightsWinStates;
+  typedef BoardEvaluationReachableWinStates::WinStateList WinStateList;
+
+  // The evaluator generates the single and double weight layers.
+  const BoardEvaluationReachableWinStates evalFunc(State::Turn_Red);
+  WinStateList winStates(evalFunc.blueWinStates);
+  winStates.insert(winStates.end(),
+                   evalFunc.redWinStates.begin(),
+                   evalFunc.redWinStates.end());
+  // Add larger layers that do not conflict with the initial board.
+  {
+    Board initBoard;
+    InitBoard(&initBoard);
+    const int firstWeights =
+      BoardEvaluationReachableWinStates::InitialWinStateWeights + 1;
+    for (int numWeights = firstWeights; numWeights <= maxWeights; ++numWeights)
+    {
+      winStates.push_back(NumWeightsWinStates());
+      NumWeightsWinStates& layer = winStates.back();
+      layer.numWeights = numWeights;
+      WinStatesNoConflict(initBoard, numWeights, &layer.states,
+                          &layer.packedStates);
+      layer.Finalize();
+      layer.BuildTouchingIndex();
+    }
+  }
+  WinStateTable::LayerList layers;
+  for (WinStateList::const_iterator layer = winStates.begin();
+       layer != winStates.end();
+       ++layer)
+  {
+    layers.push_back(layer->GetTableLayer());
+  }
+  return WinStateTable::Write(filename, layers);
+}
+
+}
+}
@@ -0,0 +1,97 @@
+#ifndef _NO_TIPPING_GAME_WIN_STATE_TABLE_H_
+#define _NO_TIPPING_GAME_WIN_STATE_TABLE_H_
+#include "mapped_file.h"
+#include <vector>
+
+namespace hps
+{
+namespace ntg
+{
+
+/// <summary> Prebuilt win state layers stored in a versioned binary file. </summary>
+/// <remarks>
+///   <para> The file holds a header, one record per layer and then the
+///     sorted 64-bit board keys, membership filter, explicit states and
+///     touching index of every layer. Layers are used in place from a
+///     read-only mapping of the file, so Load() rejects a layer whose keys
+///     are not strictly ascending or whose index is out of range.
+///   </para>
+///   <para> The header carries a checksum of the (position, weight) keys so
+///     that tables written with a different key scheme are rejected.
+///   </para>
+/// </remarks>
+class WinStateTable
+{
+public:
+  enum { Version = 2, };
+  /// <summary> Largest layer generated by default. </summary>
+  enum { DefaultMaxWeights = 3, };
+
+  /// <summary> View of one layer of sorted win state keys. </summary>
+  struct Layer
+  {
+    int numWeights;
+    int filterShift;
+    const unsigned long long* states;
+    size_t stateCount;
+    const unsigned long long* filter;
+    size_t filterWords;
+    /// <summary> One packed sub-board per key, in no particular order. </summary>
+    const unsigned long long* packedStates;
+    /// <summary> Offsets into touching for each (position, weight). </summary>
+    const unsigned int* touchingBegin;
+    /// <summary> Indices of packedStates grouped by (position, weight). </summary>
+    const unsigned int* touching;
+    size_t touchingCount;
+  };
+  typedef std::vector<Layer> LayerList;
+
+  /// <summary> Default file name, relative to the working directory. </summary>
+  static const char* DefaultFilename()
+  {
+    return "ntg_winstates.bin";
+  }
+
+  WinStateTable() : m_file(), m_layers() {}
+
+  /// <summary> Map the file and validate its contents. </summary>
+  bool Load(const char* filename);
+
+  /// <summary> Write the layers to a file. </summary>
+  static bool Write(const char* filename, const LayerList& layers);
+
+  inline bool IsLoaded() const
+  {
+    return m_file.IsOpen();
+  }
+  inline const LayerList& GetLayers() const
+  {
+    return m_layers;
+  }
+
+private:
+  // Not copyable.
+  WinStateTable(const WinStateTable&);
+  WinStateTable& operator=(const WinStateTable&);
+
+  MappedFile m_file;
+  LayerList m_layers;
+};
+
+/// <summary> Generate the win states for the standard initial board and
+///   write them to a table file.
+/// </summary>
+/// <remarks>
+///   <para> Writes the single and double weight layers that the evaluator
+///     builds at construction and the layers with up to maxWeights weights
+///     that do not conflict with the initial board. The evaluator scores
+///     with those until Update() derives them from the current board.
+///   </para>
+/// </remarks>
+bool WriteStandardWinStateTable(const char* filename, const int maxWeights);
+
+}
+using namespace ntg;
+}
+
+#endif //_NO_TIPPING_GAME_WIN_STATE_TABLE_H_
@@ -0,0 +1,34 @@
+#include "win_state_table.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace hps;
+
+int main(int argc, char** argv)
+{
+  if ((argc < 2) || (argc > 3))
+  {
+    std::cerr << "Usage: " << argv[0] << " <table file> [max weights]"
+              << std::endl;
+    return 1;
+  }
+  const char* filename = argv[1];
+  int maxWeights = WinStateTable::DefaultMaxWeights;
+  if (argc > 2)
+  {
+    maxWeights = atoi(argv[2]);
+  }
+  if (!WriteStandardWinStateTable(filename, maxWeights))
+  {
+    std::cerr << "Failed to write " << filename << "." << std::endl;
+    return 1;
+  }
+  // Check that the table loads.
+  WinStateTable table;
+  if (!table.Load(filename))
+  {
+    std::cerr << "Failed to load " << filename << "." << std::endl;
+    return 1;
+  }
+  return 0;
+}